@@ -1,5 +1,11 @@
 #include "bls.h"
+#include "verify_scheduler.h"
+#include "aggregation_pool.h"
 #include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fstream>
+#include <sstream>
 
 // Use Catch for the testing framework
 // https://github.com/philsquared/Catch/blob/master/docs/tutorial.md
@@ -488,3 +494,1858 @@ TEST_CASE("benchmark hashing onto curve", "[bench] [bench_hash]") {
     ));
    cout << out << "  microseconds" << endl;
 }
+
+TEST_CASE("Benchmark single final exponentiation verification", "[bench]") {
+  size_t iteration_count = 300;
+
+  Bls my_bls = Bls();
+  const char *seed = "15267802884793550383558706039165621050290089775961208824303765753922461897946";
+  PubKey pubkey = my_bls.genPubKey(seed);
+
+  const char *msg = "That's how the cookie crumbles";
+  const char *invalid_msg = "That't how the cookie crumbles";
+  Sig my_sig = my_bls.signMsg(msg, seed, pubkey);
+
+  // both paths must agree
+  CHECK(my_bls.verifySig(pubkey, msg, my_sig, true));
+  CHECK(my_bls.verifySig(pubkey, msg, my_sig, false));
+  CHECK_FALSE(my_bls.verifySig(pubkey, invalid_msg, my_sig, true));
+  CHECK_FALSE(my_bls.verifySig(pubkey, invalid_msg, my_sig, false));
+
+  cout << "Two pairing Bls::verifySig (microseconds): ";
+  int out = (BENCHMARK(
+     my_bls.verifySig(pubkey, msg, my_sig, false),
+     iteration_count
+  ));
+  cout << out << endl;
+
+  cout << "Single final exponentiation Bls::verifySig (microseconds): ";
+  out = (BENCHMARK(
+     my_bls.verifySig(pubkey, msg, my_sig, true),
+     iteration_count
+  ));
+  cout << out << endl;
+}
+
+TEST_CASE("Batch verification of independent signatures", "[bls]") {
+  Bls my_bls = Bls();
+
+  const char *seeds[4] = {"1232334", "456237", "8010121", "19283492834298123123"};
+  const char *msgs[4] = {"message 1", "message 2", "message 3", "message 4"};
+
+  std::vector<sigTriple> batch;
+  for(size_t i=0; i < 4; i++) {
+    PubKey pubkey = my_bls.genPubKey(seeds[i]);
+    batch.push_back({pubkey, msgs[i], my_bls.signMsg(msgs[i], seeds[i], pubkey)});
+  }
+
+  CHECK(my_bls.verifyBatch(std::vector<sigTriple>()));
+  CHECK(my_bls.verifyBatch(batch));
+
+  // one bad signature rejects the whole batch
+  std::vector<sigTriple> bad_batch = batch;
+  bad_batch[2].msg = "message 5";
+  CHECK_FALSE(my_bls.verifyBatch(bad_batch));
+
+  // shifting two signatures by +D and -D keeps their sum valid but must be rejected
+  std::vector<sigTriple> shifted_batch = batch;
+  shifted_batch[0].sig = Sig(batch[0].sig.ec1 + my_bls.g1);
+  shifted_batch[1].sig = Sig(batch[1].sig.ec1 - my_bls.g1);
+  CHECK(my_bls.verifyAggSig(
+    {batch[0].msg, batch[1].msg},
+    {batch[0].pubkey, batch[1].pubkey},
+    my_bls.aggregateSigs({shifted_batch[0].sig, shifted_batch[1].sig})
+  ));
+  CHECK_FALSE(my_bls.verifyBatch(shifted_batch));
+}
+
+TEST_CASE("Failed batches report the invalid signatures", "[bls]") {
+  Bls my_bls = Bls();
+
+  std::vector<std::string> msgs;
+  for(size_t i=0; i < 11; i++) {
+    msgs.push_back("batch message " + std::to_string(i));
+  }
+
+  std::vector<sigTriple> batch;
+  for(size_t i=0; i < msgs.size(); i++) {
+    mie::Vuint seed(1000 + i);
+    PubKey pubkey = my_bls.genPubKey(seed);
+    batch.push_back({pubkey, msgs[i].c_str(), my_bls.signMsg(msgs[i].c_str(), seed, pubkey)});
+  }
+
+  std::vector<size_t> bad_indices;
+  CHECK(my_bls.verifyBatch(batch, bad_indices));
+  CHECK(bad_indices.empty());
+
+  // corrupt entries 1, 6 and the last (padding) leaf
+  std::vector<sigTriple> bad_batch = batch;
+  bad_batch[1].sig = batch[2].sig;
+  bad_batch[6].msg = "not the signed message";
+  bad_batch[10].pubkey = batch[9].pubkey;
+
+  CHECK_FALSE(my_bls.verifyBatch(bad_batch, bad_indices));
+  std::sort(bad_indices.begin(), bad_indices.end());
+  REQUIRE(bad_indices.size() == 3);
+  CHECK(bad_indices[0] == 1);
+  CHECK(bad_indices[1] == 6);
+  CHECK(bad_indices[2] == 10);
+
+  // a single bad triple
+  std::vector<sigTriple> single(1, bad_batch[6]);
+  CHECK_FALSE(my_bls.verifyBatch(single, bad_indices));
+  REQUIRE(bad_indices.size() == 1);
+  CHECK(bad_indices[0] == 0);
+}
+
+TEST_CASE("Multi-threaded aggregate verification matches the serial path", "[bls]") {
+  Bls my_bls = Bls();
+
+  std::vector<std::string> msg_strs;
+  std::vector<const char*> msgs;
+  std::vector<PubKey> pubkeys;
+  std::vector<Sig> sigs;
+
+  for(size_t i=0; i < 13; i++) {
+    msg_strs.push_back("aggregate message " + std::to_string(i));
+  }
+
+  for(size_t i=0; i < msg_strs.size(); i++) {
+    mie::Vuint seed(5000 + i);
+    PubKey pubkey = my_bls.genPubKey(seed);
+    msgs.push_back(msg_strs[i].c_str());
+    pubkeys.push_back(pubkey);
+    sigs.push_back(my_bls.signMsg(msgs[i], seed, pubkey));
+  }
+
+  Sig agg_sig = my_bls.aggregateSigs(sigs);
+  std::vector<const char*> bad_msgs = msgs;
+  bad_msgs[7] = "not the signed message";
+
+  bool serial_valid = my_bls.verifyAggSig(msgs, pubkeys, agg_sig);
+  bool serial_invalid = my_bls.verifyAggSig(bad_msgs, pubkeys, agg_sig);
+  CHECK(serial_valid);
+  CHECK_FALSE(serial_invalid);
+
+  size_t thread_counts[4] = {2, 3, 4, 16};
+  for(size_t t : thread_counts) {
+    my_bls.setNumThreads(t);
+    CHECK(my_bls.getNumThreads() == t);
+    CHECK(my_bls.verifyAggSig(msgs, pubkeys, agg_sig) == serial_valid);
+    CHECK(my_bls.verifyAggSig(msgs, pubkeys, agg_sig, false) == serial_valid);
+    CHECK(my_bls.verifyAggSig(bad_msgs, pubkeys, agg_sig) == serial_invalid);
+  }
+
+  my_bls.setNumThreads(1);
+  CHECK(my_bls.getNumThreads() == 1);
+}
+
+TEST_CASE("Benchmark multi-threaded aggregate verification", "[bench]") {
+  size_t iteration_count = 3;
+  size_t n = 1000;
+
+  Bls my_bls = Bls();
+  std::vector<std::string> msg_strs;
+  std::vector<const char*> msgs;
+  std::vector<PubKey> pubkeys;
+  std::vector<Sig> sigs;
+
+  for(size_t i=0; i < n; i++) {
+    msg_strs.push_back(gen_random_str(55));
+  }
+
+  for(size_t i=0; i < n; i++) {
+    mie::Vuint seed(rand());
+    PubKey pubkey = my_bls.genPubKey(seed);
+    msgs.push_back(msg_strs[i].c_str());
+    pubkeys.push_back(pubkey);
+    sigs.push_back(my_bls.signMsg(msgs[i], seed, pubkey));
+  }
+
+  Sig agg_sig = my_bls.aggregateSigs(sigs);
+
+  cout << "THREADS         TIME (" << n << " signers)" << endl;
+  size_t max_threads = std::max(2u, std::thread::hardware_concurrency());
+  for(size_t t=1; t <= max_threads; t *= 2) {
+    my_bls.setNumThreads(t);
+    bool valid = false;
+    int out = (BENCHMARK(
+       valid = my_bls.verifyAggSig(msgs, pubkeys, agg_sig),
+       iteration_count
+    ));
+    CHECK(valid);
+    cout << t << "         " << out << endl;
+  }
+}
+
+TEST_CASE("Prepared pubkeys verify like plain pubkeys", "[bls]") {
+  Bls my_bls = Bls();
+
+  const char *seeds[3] = {"1232334", "456237", "8010121"};
+  const char *msgs_arr[3] = {"message 1", "message 2", "message 3"};
+
+  std::vector<PubKey> pubkeys;
+  std::vector<PreparedPubKey> prepared;
+  std::vector<const char*> msgs;
+  std::vector<Sig> sigs;
+
+  for(size_t i=0; i < 3; i++) {
+    PubKey pubkey = my_bls.genPubKey(seeds[i]);
+    pubkeys.push_back(pubkey);
+    prepared.push_back(PreparedPubKey(pubkey));
+    msgs.push_back(msgs_arr[i]);
+    sigs.push_back(my_bls.signMsg(msgs_arr[i], seeds[i], pubkey));
+  }
+
+  CHECK(prepared[0].ec2 == pubkeys[0].ec2);
+  CHECK(prepared[0].memoryFootprint() > sizeof(PreparedPubKey));
+
+  CHECK(my_bls.verifySig(prepared[0], msgs[0], sigs[0]));
+  CHECK_FALSE(my_bls.verifySig(prepared[0], msgs[1], sigs[0]));
+  CHECK_FALSE(my_bls.verifySig(prepared[1], msgs[0], sigs[0]));
+
+  std::vector<const PreparedPubKey*> prepared_ptrs;
+  for(size_t i=0; i < prepared.size(); i++) prepared_ptrs.push_back(&prepared[i]);
+
+  Sig agg_sig = my_bls.aggregateSigs(sigs);
+  CHECK(my_bls.verifyAggSig(msgs, prepared_ptrs, agg_sig));
+  CHECK_FALSE(my_bls.verifyAggSig(msgs, prepared_ptrs, sigs[0]));
+
+  std::swap(prepared_ptrs[0], prepared_ptrs[1]);
+  CHECK_FALSE(my_bls.verifyAggSig(msgs, prepared_ptrs, agg_sig));
+}
+
+TEST_CASE("Benchmark prepared pubkey verification", "[bench]") {
+  size_t iteration_count = 300;
+
+  Bls my_bls = Bls();
+  const char *seed = "15267802884793550383558706039165621050290089775961208824303765753922461897946";
+  PubKey pubkey = my_bls.genPubKey(seed);
+  PreparedPubKey prepared(pubkey);
+
+  const char *msg = "That's how the cookie crumbles";
+  Sig my_sig = my_bls.signMsg(msg, seed, pubkey);
+
+  cout << "PreparedPubKey memory footprint (bytes): " << prepared.memoryFootprint() << endl;
+
+  cout << "Bls::verifySig with PubKey (microseconds): ";
+  int out = (BENCHMARK(
+     my_bls.verifySig(pubkey, msg, my_sig),
+     iteration_count
+  ));
+  cout << out << endl;
+
+  cout << "Bls::verifySig with PreparedPubKey (microseconds): ";
+  out = (BENCHMARK(
+     my_bls.verifySig(prepared, msg, my_sig),
+     iteration_count
+  ));
+  cout << out << endl;
+}
+
+TEST_CASE("Aggregate verification groups messages by pubkey", "[bls]") {
+  Bls my_bls = Bls();
+
+  const char *seeds[2] = {"1232334", "456237"};
+  PubKey pubkey_1 = my_bls.genPubKey(seeds[0]);
+  PubKey pubkey_2 = my_bls.genPubKey(seeds[1]);
+
+  std::vector<std::string> msg_strs;
+  std::vector<const char*> msgs;
+  std::vector<PubKey> pubkeys;
+  std::vector<Sig> sigs;
+
+  for(size_t i=0; i < 7; i++) {
+    msg_strs.push_back("grouped message " + std::to_string(i));
+  }
+
+  // interleave the two signers, each pubkey is a separate copy
+  for(size_t i=0; i < msg_strs.size(); i++) {
+    size_t signer = (i % 3 == 0) ? 1 : 0;
+    PubKey pubkey = my_bls.genPubKey(seeds[signer]);
+    msgs.push_back(msg_strs[i].c_str());
+    pubkeys.push_back(pubkey);
+    sigs.push_back(my_bls.signMsg(msgs[i], seeds[signer], pubkey));
+  }
+
+  Sig agg_sig = my_bls.aggregateSigs(sigs);
+  CHECK(my_bls.verifyAggSig(msgs, pubkeys, agg_sig));
+  CHECK(my_bls.verifyAggSig(msgs, pubkeys, agg_sig, true, false));
+  CHECK(my_bls.verifyAggSig(msgs, pubkeys, agg_sig, false, true));
+
+  // moving a message to the other signer must fail
+  std::vector<PubKey> bad_pubkeys = pubkeys;
+  bad_pubkeys[1] = pubkey_2;
+  CHECK_FALSE(my_bls.verifyAggSig(msgs, bad_pubkeys, agg_sig));
+  CHECK_FALSE(my_bls.verifyAggSig(msgs, bad_pubkeys, agg_sig, true, false));
+
+  PreparedPubKey prepared_1(pubkey_1);
+  PreparedPubKey prepared_2(pubkey_2);
+  std::vector<const PreparedPubKey*> prepared;
+  for(size_t i=0; i < msgs.size(); i++) {
+    prepared.push_back((i % 3 == 0) ? &prepared_2 : &prepared_1);
+  }
+  CHECK(my_bls.verifyAggSig(msgs, prepared, agg_sig));
+  CHECK(my_bls.verifyAggSig(msgs, prepared, agg_sig, false));
+  CHECK(my_bls.verifyAggSig(msgs, prepared, agg_sig, true, false));
+  CHECK(my_bls.verifyAggSig(msgs, prepared, agg_sig, false, false));
+  CHECK_FALSE(my_bls.verifyAggSig(msgs, prepared, sigs[0], false));
+}
+
+TEST_CASE("Benchmark aggregate verification grouped by pubkey", "[bench]") {
+  size_t iteration_count = 3;
+  size_t n = 128;
+
+  Bls my_bls = Bls();
+  std::vector<std::string> msg_strs;
+  for(size_t i=0; i < n; i++) {
+    msg_strs.push_back(gen_random_str(55));
+  }
+
+  cout << "MSGS PER KEY    UNGROUPED    GROUPED (" << n << " messages)" << endl;
+  for(size_t per_key=1; per_key <= 64; per_key *= 2) {
+    std::vector<const char*> msgs;
+    std::vector<PubKey> pubkeys;
+    std::vector<Sig> sigs;
+
+    for(size_t k=0; k < n / per_key; k++) {
+      mie::Vuint seed(rand());
+      PubKey pubkey = my_bls.genPubKey(seed);
+      for(size_t j=0; j < per_key; j++) {
+        const char *msg = msg_strs[k * per_key + j].c_str();
+        msgs.push_back(msg);
+        pubkeys.push_back(pubkey);
+        sigs.push_back(my_bls.signMsg(msg, seed, pubkey));
+      }
+    }
+
+    Sig agg_sig = my_bls.aggregateSigs(sigs);
+
+    bool valid = false;
+    int ungrouped = (BENCHMARK(
+       valid = my_bls.verifyAggSig(msgs, pubkeys, agg_sig, true, false),
+       iteration_count
+    ));
+    CHECK(valid);
+
+    valid = false;
+    int grouped = (BENCHMARK(
+       valid = my_bls.verifyAggSig(msgs, pubkeys, agg_sig, true, true),
+       iteration_count
+    ));
+    CHECK(valid);
+
+    cout << per_key << "         " << ungrouped << "         " << grouped << endl;
+  }
+}
+
+TEST_CASE("Incremental aggregate verifier", "[bls]") {
+  Bls my_bls = Bls();
+  AggVerifier verifier(my_bls);
+
+  const char *seeds[3] = {"1232334", "456237", "8010121"};
+  const char *msgs[3] = {"message 1", "message 2", "message 3"};
+
+  std::vector<PubKey> pubkeys;
+  std::vector<Sig> sigs;
+  for(size_t i=0; i < 3; i++) {
+    pubkeys.push_back(my_bls.genPubKey(seeds[i]));
+    sigs.push_back(my_bls.signMsg(msgs[i], seeds[i], pubkeys[i]));
+  }
+
+  CHECK(verifier.check());
+
+  for(size_t i=0; i < 3; i++) {
+    verifier.add(pubkeys[i], msgs[i], sigs[i]);
+    CHECK(verifier.check());
+  }
+  CHECK(verifier.size() == 3);
+  CHECK(verifier.aggregateSig().ec1 == my_bls.aggregateSigs(sigs).ec1);
+
+  // a bad signer fails the aggregate until it is removed again
+  verifier.add(pubkeys[0], msgs[1], sigs[1]);
+  CHECK_FALSE(verifier.check());
+  verifier.remove(pubkeys[0], msgs[1], sigs[1]);
+  CHECK(verifier.check());
+
+  verifier.remove(pubkeys[1], msgs[1], sigs[1]);
+  CHECK(verifier.size() == 2);
+  CHECK(verifier.check());
+
+  std::vector<const char*> remaining_msgs = {msgs[0], msgs[2]};
+  std::vector<PubKey> remaining_pubkeys = {pubkeys[0], pubkeys[2]};
+  CHECK(my_bls.verifyAggSig(remaining_msgs, remaining_pubkeys, verifier.aggregateSig()));
+}
+
+TEST_CASE("Pipelined aggregate verification", "[bls]") {
+  Bls my_bls = Bls();
+
+  std::vector<std::string> msg_strs;
+  std::vector<const char*> msgs;
+  std::vector<PubKey> pubkeys;
+  std::vector<Sig> sigs;
+
+  for(size_t i=0; i < 9; i++) {
+    msg_strs.push_back("pipelined message " + std::to_string(i));
+  }
+
+  for(size_t i=0; i < msg_strs.size(); i++) {
+    mie::Vuint seed(7000 + i % 5);
+    PubKey pubkey = my_bls.genPubKey(seed);
+    msgs.push_back(msg_strs[i].c_str());
+    pubkeys.push_back(pubkey);
+    sigs.push_back(my_bls.signMsg(msgs[i], seed, pubkey));
+  }
+
+  Sig agg_sig = my_bls.aggregateSigs(sigs);
+  std::vector<const char*> bad_msgs = msgs;
+  bad_msgs[4] = "not the signed message";
+
+  pipelineConfig configs[3] = {{1, 1, 1}, {2, 3, 2}, {3, 1, 16}};
+  for(const pipelineConfig &config : configs) {
+    pipelineStats stats;
+    CHECK(my_bls.verifyAggSig(msgs, pubkeys, agg_sig, config, &stats));
+    CHECK(stats.queue_capacity == config.queue_capacity);
+    CHECK(stats.max_queue_depth <= config.queue_capacity);
+    CHECK_FALSE(my_bls.verifyAggSig(bad_msgs, pubkeys, agg_sig, config));
+  }
+}
+
+TEST_CASE("Benchmark pipelined aggregate verification", "[bench]") {
+  size_t iteration_count = 3;
+  size_t n = 1000;
+
+  Bls my_bls = Bls();
+  std::vector<std::string> msg_strs;
+  std::vector<const char*> msgs;
+  std::vector<PubKey> pubkeys;
+  std::vector<Sig> sigs;
+
+  for(size_t i=0; i < n; i++) {
+    msg_strs.push_back(gen_random_str(55));
+  }
+
+  for(size_t i=0; i < n; i++) {
+    mie::Vuint seed(rand());
+    PubKey pubkey = my_bls.genPubKey(seed);
+    msgs.push_back(msg_strs[i].c_str());
+    pubkeys.push_back(pubkey);
+    sigs.push_back(my_bls.signMsg(msgs[i], seed, pubkey));
+  }
+
+  Sig agg_sig = my_bls.aggregateSigs(sigs);
+
+  cout << "HASH  MILLER  QUEUE    TIME    MAX DEPTH  AVG DEPTH  HASH STALLS  MILLER STALLS (" << n << " signers)" << endl;
+  pipelineConfig configs[5] = {{1, 1, 16}, {1, 2, 16}, {1, 3, 16}, {2, 2, 16}, {1, 3, 64}};
+  for(const pipelineConfig &config : configs) {
+    pipelineStats stats;
+    bool valid = false;
+    int out = (BENCHMARK(
+       valid = my_bls.verifyAggSig(msgs, pubkeys, agg_sig, config, &stats),
+       iteration_count
+    ));
+    CHECK(valid);
+    cout << config.hash_threads << "     " << config.miller_threads << "       " << config.queue_capacity
+         << "       " << out << "    " << stats.max_queue_depth << "        " << stats.avg_queue_depth
+         << "        " << stats.hash_stalls << "           " << stats.miller_stalls << endl;
+  }
+}
+
+TEST_CASE("Low latency single verification", "[bls]") {
+  Bls my_bls = Bls();
+  const char *seed = "19283492834298123123";
+  PubKey pubkey = my_bls.genPubKey(seed);
+
+  const char *msg = "That's how the cookie crumbles";
+  const char *invalid_msg = "That't how the cookie crumbles";
+  Sig sig = my_bls.signMsg(msg, seed, pubkey);
+
+  // falls back to the serial path until enabled
+  CHECK(my_bls.verifySigLowLatency(pubkey, msg, sig));
+
+  my_bls.setLowLatency(true);
+  CHECK(my_bls.verifySigLowLatency(pubkey, msg, sig));
+  CHECK_FALSE(my_bls.verifySigLowLatency(pubkey, invalid_msg, sig));
+  my_bls.setLowLatency(false);
+}
+
+// sorted per call latencies in microseconds
+std::vector<long> measure_latencies(std::function<void()> fn, size_t count) {
+  std::vector<long> latencies;
+  for(size_t i=0; i < count; i++) {
+    struct timeval timeStart, timeEnd;
+    gettimeofday(&timeStart, NULL);
+    fn();
+    gettimeofday(&timeEnd, NULL);
+    latencies.push_back((timeEnd.tv_sec - timeStart.tv_sec) * 1000000 + timeEnd.tv_usec - timeStart.tv_usec);
+  }
+  std::sort(latencies.begin(), latencies.end());
+  return latencies;
+}
+
+TEST_CASE("Benchmark low latency single verification", "[bench]") {
+  size_t iteration_count = 500;
+
+  Bls my_bls = Bls();
+  const char *seed = "15267802884793550383558706039165621050290089775961208824303765753922461897946";
+  PubKey pubkey = my_bls.genPubKey(seed);
+  const char *msg = "That's how the cookie crumbles";
+  Sig my_sig = my_bls.signMsg(msg, seed, pubkey);
+
+  my_bls.setLowLatency(true);
+
+  std::vector<long> serial = measure_latencies([&]() { my_bls.verifySig(pubkey, msg, my_sig); }, iteration_count);
+  std::vector<long> low_latency = measure_latencies([&]() { my_bls.verifySigLowLatency(pubkey, msg, my_sig); }, iteration_count);
+
+  size_t p50 = iteration_count / 2;
+  size_t p99 = iteration_count * 99 / 100;
+
+  cout << "PATH            P50 (us)    P99 (us)" << endl;
+  cout << "serial          " << serial[p50] << "         " << serial[p99] << endl;
+  cout << "low latency     " << low_latency[p50] << "         " << low_latency[p99] << endl;
+  cout << "gain            " << serial[p50] - low_latency[p50] << "         " << serial[p99] - low_latency[p99] << endl;
+}
+
+TEST_CASE("Partial pairing products combine across processes", "[bls]") {
+  Bls my_bls = Bls();
+
+  std::vector<std::string> msg_strs;
+  std::vector<const char*> msgs;
+  std::vector<PubKey> pubkeys;
+  std::vector<Sig> sigs;
+
+  for(size_t i=0; i < 10; i++) {
+    msg_strs.push_back("sharded message " + std::to_string(i));
+  }
+
+  for(size_t i=0; i < msg_strs.size(); i++) {
+    mie::Vuint seed(9000 + i % 4);
+    PubKey pubkey = my_bls.genPubKey(seed);
+    msgs.push_back(msg_strs[i].c_str());
+    pubkeys.push_back(pubkey);
+    sigs.push_back(my_bls.signMsg(msgs[i], seed, pubkey));
+  }
+
+  Sig agg_sig = my_bls.aggregateSigs(sigs);
+
+  // round trip through the binary encoding
+  PartialProduct whole = my_bls.aggPartialProduct(msgs, pubkeys, 0, msgs.size());
+  std::string encoded = whole.serialize();
+  CHECK(encoded.size() == PartialProduct::SERIALIZED_SIZE);
+  CHECK(PartialProduct(encoded).fp12 == whole.fp12);
+  CHECK_THROWS(PartialProduct(encoded.substr(1)));
+
+  // compute each slice in a forked worker process and send back the encoding
+  size_t slices[4] = {0, 3, 7, 10};
+  std::vector<PartialProduct> partials;
+  for(size_t s=0; s < 3; s++) {
+    int fds[2];
+    REQUIRE(pipe(fds) == 0);
+
+    pid_t pid = fork();
+    REQUIRE(pid >= 0);
+    if(pid == 0) {
+      close(fds[0]);
+      std::string out = my_bls.aggPartialProduct(msgs, pubkeys, slices[s], slices[s + 1]).serialize();
+      ssize_t written = write(fds[1], out.data(), out.size());
+      _exit(written == (ssize_t)out.size() ? 0 : 1);
+    }
+
+    close(fds[1]);
+    std::string in;
+    char buf[PartialProduct::SERIALIZED_SIZE];
+    ssize_t got;
+    while((got = read(fds[0], buf, sizeof(buf))) > 0) in.append(buf, got);
+    close(fds[0]);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    CHECK(WIFEXITED(status));
+    CHECK(WEXITSTATUS(status) == 0);
+
+    partials.push_back(PartialProduct(in));
+  }
+
+  CHECK(my_bls.verifyAggPartials(partials, agg_sig));
+  CHECK_FALSE(my_bls.verifyAggPartials(partials, sigs[0]));
+
+  // dropping a slice must fail
+  partials.pop_back();
+  CHECK_FALSE(my_bls.verifyAggPartials(partials, agg_sig));
+}
+
+TEST_CASE("Streaming aggregate verification", "[bls]") {
+  Bls my_bls = Bls();
+
+  std::vector<std::string> msg_strs;
+  std::vector<Sig> sigs;
+  std::stringstream records;
+
+  for(size_t i=0; i < 11; i++) {
+    msg_strs.push_back("streamed message " + std::to_string(i));
+  }
+
+  for(size_t i=0; i < msg_strs.size(); i++) {
+    mie::Vuint seed(11000 + i % 3);
+    PubKey pubkey = my_bls.genPubKey(seed);
+    my_bls.writeAggRecord(records, pubkey, msg_strs[i].c_str());
+    sigs.push_back(my_bls.signMsg(msg_strs[i].c_str(), seed, pubkey));
+  }
+
+  Sig agg_sig = my_bls.aggregateSigs(sigs);
+  std::string data = records.str();
+
+  size_t chunk_sizes[3] = {1, 4, 1024};
+  for(size_t chunk_size : chunk_sizes) {
+    std::stringstream in(data);
+    streamStats stats;
+    CHECK(my_bls.verifyAggSigStream(in, agg_sig, chunk_size, &stats));
+    CHECK(stats.records == msg_strs.size());
+
+    CHECK(my_bls.verifyAggSigStream(data.data(), data.size(), agg_sig, chunk_size));
+    CHECK_FALSE(my_bls.verifyAggSigStream(data.data(), data.size(), sigs[0], chunk_size));
+  }
+
+  // truncated record
+  CHECK_THROWS(my_bls.verifyAggSigStream(data.data(), data.size() - 3, agg_sig));
+
+  // corrupt pubkey fields: wrong component count, non digits, a point off the curve
+  std::string pubkey_str = my_bls.genPubKey(mie::Vuint(11000)).toString();
+  std::string off_curve = pubkey_str;
+  off_curve[off_curve.size() - 1] = off_curve[off_curve.size() - 1] == '1' ? '2' : '1';
+
+  std::string corrupt_fields[4] = {"1_2_3", "1_2_3_x4", "1__2_3", off_curve};
+  for(size_t i=0; i < 4; i++) {
+    std::string field = corrupt_fields[i];
+    std::string msg = "streamed message 0";
+    std::string record;
+    uint32_t lens[2] = {(uint32_t)field.size(), (uint32_t)msg.size()};
+    std::string values[2] = {field, msg};
+    for(size_t f=0; f < 2; f++) {
+      for(size_t b=0; b < 4; b++) record.push_back((char)(lens[f] >> (8 * b)));
+      record += values[f];
+    }
+
+    std::string corrupt = data + record;
+    CHECK_THROWS_AS(my_bls.verifyAggSigStream(corrupt.data(), corrupt.size(), agg_sig), std::invalid_argument&);
+  }
+}
+
+TEST_CASE("Benchmark streaming aggregate verification from disk", "[bench]") {
+  size_t n = 2000;
+
+  Bls my_bls = Bls();
+  char path[] = "/tmp/bls_stream_XXXXXX";
+  int fd = mkstemp(path);
+  REQUIRE(fd >= 0);
+  close(fd);
+
+  std::vector<Sig> sigs;
+  {
+    std::ofstream out(path, std::ios::binary);
+    for(size_t i=0; i < n; i++) {
+      std::string msg = gen_random_str(55);
+      mie::Vuint seed(rand());
+      PubKey pubkey = my_bls.genPubKey(seed);
+      my_bls.writeAggRecord(out, pubkey, msg.c_str());
+      sigs.push_back(my_bls.signMsg(msg.c_str(), seed, pubkey));
+    }
+  }
+
+  Sig agg_sig = my_bls.aggregateSigs(sigs);
+
+  cout << "CHUNK SIZE      RECORDS/S (" << n << " records)" << endl;
+  size_t chunk_sizes[3] = {64, 256, 1024};
+  for(size_t chunk_size : chunk_sizes) {
+    std::ifstream in(path, std::ios::binary);
+    streamStats stats;
+    CHECK(my_bls.verifyAggSigStream(in, agg_sig, chunk_size, &stats));
+    cout << chunk_size << "         " << stats.records_per_sec << endl;
+  }
+
+  remove(path);
+}
+
+TEST_CASE("Verification cache skips repeated triples", "[bls]") {
+  Bls my_bls = Bls();
+  std::shared_ptr<VerifyCache> cache = std::make_shared<VerifyCache>(4, 2);
+  my_bls.setVerifyCache(cache);
+
+  const char *seed = "19283492834298123123";
+  PubKey pubkey = my_bls.genPubKey(seed);
+  const char *msg = "That's how the cookie crumbles";
+  const char *invalid_msg = "That't how the cookie crumbles";
+  Sig sig = my_bls.signMsg(msg, seed, pubkey);
+
+  CHECK(my_bls.verifySig(pubkey, msg, sig));
+  CHECK(cache->misses() == 1);
+  CHECK(cache->size() == 1);
+
+  // a deserialized copy of the same triple hits
+  CHECK(my_bls.verifySig(PubKey(pubkey.toString().c_str()), msg, sig));
+  CHECK(cache->hits() == 1);
+
+  // failures are never cached
+  CHECK_FALSE(my_bls.verifySig(pubkey, invalid_msg, sig));
+  CHECK_FALSE(my_bls.verifySig(pubkey, invalid_msg, sig));
+  CHECK(cache->size() == 1);
+
+  // fill past capacity
+  for(size_t i=0; i < 6; i++) {
+    std::string m = "cached message " + std::to_string(i);
+    CHECK(my_bls.verifySig(pubkey, m.c_str(), my_bls.signMsg(m.c_str(), seed, pubkey)));
+  }
+  CHECK(cache->size() <= 4);
+  CHECK(cache->evictions() >= 3);
+
+  // snapshot survives a restart
+  char path[] = "/tmp/bls_cache_XXXXXX";
+  int fd = mkstemp(path);
+  REQUIRE(fd >= 0);
+  close(fd);
+  REQUIRE(cache->saveSnapshot(path));
+
+  std::shared_ptr<VerifyCache> restored = std::make_shared<VerifyCache>(4, 2);
+  CHECK(restored->loadSnapshot(path) == cache->size());
+  CHECK(restored->size() == cache->size());
+  remove(path);
+
+  std::string last = "cached message 5";
+  Bls other_bls = Bls();
+  other_bls.setVerifyCache(restored);
+  CHECK(other_bls.verifySig(pubkey, last.c_str(), my_bls.signMsg(last.c_str(), seed, pubkey)));
+  CHECK(restored->hits() == 1);
+
+  // prepared keys and the low latency path share the cache
+  CHECK(other_bls.verifySig(PreparedPubKey(pubkey), last.c_str(), my_bls.signMsg(last.c_str(), seed, pubkey)));
+  CHECK(restored->hits() == 2);
+  other_bls.setLowLatency(true);
+  CHECK(other_bls.verifySigLowLatency(pubkey, last.c_str(), my_bls.signMsg(last.c_str(), seed, pubkey)));
+  CHECK(restored->hits() == 3);
+  std::string fresh = "uncached message";
+  Sig fresh_sig = my_bls.signMsg(fresh.c_str(), seed, pubkey);
+  CHECK(other_bls.verifySigLowLatency(pubkey, fresh.c_str(), fresh_sig));
+  CHECK(other_bls.verifySig(PreparedPubKey(pubkey), fresh.c_str(), fresh_sig));
+  CHECK(restored->hits() == 4);
+}
+
+TEST_CASE("Benchmark verification cache hits", "[bench]") {
+  size_t iteration_count = 100000;
+
+  Bls my_bls = Bls();
+  my_bls.setVerifyCache(std::make_shared<VerifyCache>(1 << 16));
+
+  const char *seed = "15267802884793550383558706039165621050290089775961208824303765753922461897946";
+  PubKey pubkey = my_bls.genPubKey(seed);
+  const char *msg = "That's how the cookie crumbles";
+  Sig my_sig = my_bls.signMsg(msg, seed, pubkey);
+  CHECK(my_bls.verifySig(pubkey, msg, my_sig));
+
+  struct timeval timeStart, timeEnd;
+  gettimeofday(&timeStart, NULL);
+  for(size_t i=0; i < iteration_count; i++) {
+    my_bls.verifySig(pubkey, msg, my_sig);
+  }
+  gettimeofday(&timeEnd, NULL);
+
+  cout << "Cached Bls::verifySig (nanoseconds): ";
+  cout << ((timeEnd.tv_sec - timeStart.tv_sec) * 1000000 + timeEnd.tv_usec - timeStart.tv_usec) * 1000 / iteration_count;
+  cout << endl;
+}
+
+TEST_CASE("Variable time operations match the constant time ones", "[bls]") {
+  Bls my_bls = Bls();
+
+  mie::Vuint ord("16798108731015832284940804142231733909759579603404752749028378864165570215949");
+  std::vector<mie::Vuint> scalars;
+  scalars.push_back(mie::Vuint(0));
+  scalars.push_back(mie::Vuint(1));
+  scalars.push_back(mie::Vuint(2));
+  scalars.push_back(mie::Vuint("18446744073709551615"));
+  scalars.push_back(mie::Vuint("15267802884793550383558706039165621050290089775961208824303765753922461897946"));
+  scalars.push_back(ord - 1);
+
+  for(size_t i=0; i < scalars.size(); i++) {
+    CHECK(my_bls.mulVarTime(my_bls.g1, scalars[i]) == my_bls.g1 * scalars[i]);
+    CHECK(my_bls.mulVarTime(my_bls.g2, scalars[i]) == my_bls.g2 * scalars[i]);
+  }
+}
+
+TEST_CASE("Benchmark variable time scalar multiplication", "[bench]") {
+  size_t iteration_count = 1000;
+
+  Bls my_bls = Bls();
+  mie::Vuint full("15267802884793550383558706039165621050290089775961208824303765753922461897946");
+  mie::Vuint weight("11400714819323198485");
+  Ec1 out;
+
+  cout << "Ec1 * 254 bit scalar (microseconds): ";
+  int t1 = (BENCHMARK((out = my_bls.g1 * full), iteration_count));
+  cout << t1 << endl;
+  cout << "Bls::mulVarTime 254 bit scalar (microseconds): ";
+  int t2 = (BENCHMARK((out = my_bls.mulVarTime(my_bls.g1, full)), iteration_count));
+  cout << t2 << endl;
+  cout << "Ec1 * 64 bit scalar (microseconds): ";
+  int t3 = (BENCHMARK((out = my_bls.g1 * weight), iteration_count));
+  cout << t3 << endl;
+  cout << "Bls::mulVarTime 64 bit scalar (microseconds): ";
+  int t4 = (BENCHMARK((out = my_bls.mulVarTime(my_bls.g1, weight)), iteration_count));
+  cout << t4 << endl;
+}
+
+TEST_CASE("Batch verification of threshold signature shares", "[bls]") {
+  Bls my_bls = Bls();
+  const char* secret = "12345";
+  const char* msg = "this is a test message";
+  PubKey pubkey = my_bls.genPubKey(secret);
+
+  size_t t = 3;
+  std::vector<thresholdPoint> points;
+  my_bls.genThreshKeys(secret, t, 7, points);
+
+  std::vector<thresholdSigPoint> shares;
+  std::vector<PubKey> share_pubkeys;
+  for(size_t i=0; i < points.size(); i++) {
+    shares.push_back({points[i].x, my_bls.signMsg(msg, points[i].y.get(), pubkey)});
+    share_pubkeys.push_back(my_bls.genPubKey(points[i].y.get()));
+  }
+
+  CHECK(my_bls.verifyThresholdShares(shares, share_pubkeys, msg, pubkey));
+
+  // shares over a different message do not verify
+  CHECK_FALSE(my_bls.verifyThresholdShares(shares, share_pubkeys, "another message", pubkey));
+
+  // shares hashed with their own pubkey instead of the group pubkey do not verify
+  std::vector<thresholdSigPoint> own_key_shares;
+  for(size_t i=0; i < points.size(); i++) {
+    own_key_shares.push_back({points[i].x, my_bls.signMsg(msg, points[i].y.get(), share_pubkeys[i])});
+  }
+  CHECK_FALSE(my_bls.verifyThresholdShares(own_key_shares, share_pubkeys, msg, pubkey));
+
+  // a single corrupted share fails the whole set
+  std::vector<thresholdSigPoint> bad_shares = shares;
+  bad_shares[4].y = Sig(bad_shares[4].y.ec1 + my_bls.g1);
+  CHECK_FALSE(my_bls.verifyThresholdShares(bad_shares, share_pubkeys, msg, pubkey));
+
+  // two shares swapped between signers fail as well
+  bad_shares = shares;
+  std::swap(bad_shares[1].y, bad_shares[2].y);
+  CHECK_FALSE(my_bls.verifyThresholdShares(bad_shares, share_pubkeys, msg, pubkey));
+
+  share_pubkeys.pop_back();
+  CHECK_THROWS(my_bls.verifyThresholdShares(shares, share_pubkeys, msg, pubkey));
+}
+
+TEST_CASE("Benchmark threshold share verification", "[bench]") {
+  size_t iteration_count = 10;
+
+  Bls my_bls = Bls();
+  const char* secret = "12345";
+  const char* msg = "this is a test message";
+  PubKey pubkey = my_bls.genPubKey(secret);
+
+  size_t max_n = 128;
+  std::vector<thresholdPoint> points;
+  my_bls.genThreshKeys(secret, 3, max_n, points);
+
+  std::vector<thresholdSigPoint> shares;
+  std::vector<PubKey> share_pubkeys;
+  for(size_t i=0; i < points.size(); i++) {
+    shares.push_back({points[i].x, my_bls.signMsg(msg, points[i].y.get(), pubkey)});
+    share_pubkeys.push_back(my_bls.genPubKey(points[i].y.get()));
+  }
+
+  cout << "SHARES     INDIVIDUAL     BATCHED (microseconds)" << endl;
+  for(size_t n=2; n <= max_n; n *= 2) {
+    std::vector<thresholdSigPoint> s(shares.begin(), shares.begin() + n);
+    std::vector<PubKey> pks(share_pubkeys.begin(), share_pubkeys.begin() + n);
+
+    // shares are hashed with the group pubkey so verifySig rejects them,
+    // but it does the same two pairings per share that a share by share check needs
+    int individual = (BENCHMARK(
+       { for(size_t j=0; j < n; j++) { my_bls.verifySig(pks[j], msg, s[j].y, false); } },
+       iteration_count
+    ));
+    int batched = (BENCHMARK(
+       { my_bls.verifyThresholdShares(s, pks, msg, pubkey); },
+       iteration_count
+    ));
+    cout << n << "     " << individual << "     " << batched << endl;
+  }
+}
+
+TEST_CASE("Verification scheduler lanes and deadlines", "[bls]") {
+  Bls my_bls = Bls();
+
+  size_t n = 12;
+  std::vector<std::string> msgs;
+  std::vector<PubKey> pubkeys;
+  std::vector<Sig> sigs;
+  for(size_t i=0; i < n; i++) {
+    std::string seed = std::to_string(1000 + i);
+    msgs.push_back("scheduled message " + std::to_string(i));
+    pubkeys.push_back(my_bls.genPubKey(seed.c_str()));
+    sigs.push_back(my_bls.signMsg(msgs[i].c_str(), seed.c_str(), pubkeys[i]));
+  }
+
+  schedulerConfig config = VerifyScheduler::defaultConfig();
+  config.max_batch = 4;
+  VerifyScheduler scheduler(my_bls, config);
+
+  // low priority singles, one of them invalid
+  std::vector<std::future<bool> > low;
+  for(size_t i=0; i < 8; i++) {
+    Sig sig = (i == 5) ? sigs[0] : sigs[i];
+    low.push_back(scheduler.submit({pubkeys[i], msgs[i].c_str(), sig}, PRIORITY_LOW));
+  }
+
+  // high priority single and aggregate
+  std::future<bool> high = scheduler.submit({pubkeys[8], msgs[8].c_str(), sigs[8]}, PRIORITY_HIGH,
+    VerifyScheduler::clock::now() + std::chrono::seconds(10));
+
+  std::vector<const char*> agg_msgs;
+  std::vector<PubKey> agg_pubkeys;
+  std::vector<Sig> agg_sigs;
+  for(size_t i=9; i < n; i++) {
+    agg_msgs.push_back(msgs[i].c_str());
+    agg_pubkeys.push_back(pubkeys[i]);
+    agg_sigs.push_back(sigs[i]);
+  }
+  Sig agg_sig = my_bls.aggregateSigs(agg_sigs);
+  std::future<bool> high_agg = scheduler.submitAgg(agg_msgs, agg_pubkeys, agg_sig, PRIORITY_HIGH);
+  std::future<bool> low_agg = scheduler.submitAgg(agg_msgs, agg_pubkeys, sigs[0], PRIORITY_LOW);
+
+  // a deadline in the past is always missed but the request still runs
+  std::future<bool> late = scheduler.submit({pubkeys[0], msgs[0].c_str(), sigs[0]}, PRIORITY_HIGH,
+    VerifyScheduler::clock::now() - std::chrono::seconds(1));
+
+  CHECK(high.get());
+  CHECK(high_agg.get());
+  CHECK(late.get());
+  CHECK_FALSE(low_agg.get());
+  for(size_t i=0; i < low.size(); i++) {
+    CHECK(low[i].get() == (i != 5));
+  }
+
+  schedulerStats stats = scheduler.stats();
+  CHECK(stats.high_requests == 3);
+  CHECK(stats.low_requests == 9);
+  CHECK(stats.high_deadline_misses >= 1);
+  CHECK(stats.low_deadline_misses == 0);
+  CHECK(stats.low_batches >= 3);
+  CHECK(stats.avg_low_batch_size <= 4);
+  CHECK(stats.max_low_wait_us >= stats.avg_low_wait_us);
+}
+
+TEST_CASE("Benchmark scheduler latency under bulk load", "[bench]") {
+  Bls my_bls = Bls();
+
+  size_t bulk_n = 512;
+  size_t high_n = 20;
+  std::vector<std::string> msgs;
+  std::vector<PubKey> pubkeys;
+  std::vector<Sig> sigs;
+  for(size_t i=0; i < bulk_n; i++) {
+    std::string seed = std::to_string(5000 + i);
+    msgs.push_back("bulk message " + std::to_string(i));
+    pubkeys.push_back(my_bls.genPubKey(seed.c_str()));
+    sigs.push_back(my_bls.signMsg(msgs[i].c_str(), seed.c_str(), pubkeys[i]));
+  }
+
+  VerifyScheduler scheduler(my_bls);
+
+  struct timeval timeStart, timeEnd;
+  gettimeofday(&timeStart, NULL);
+
+  std::vector<std::future<bool> > bulk;
+  for(size_t i=0; i < bulk_n; i++) {
+    bulk.push_back(scheduler.submit({pubkeys[i], msgs[i].c_str(), sigs[i]}, PRIORITY_LOW));
+  }
+
+  // proposals arrive while the sync backlog is being worked off, each with a 20ms budget
+  for(size_t i=0; i < high_n; i++) {
+    std::future<bool> high = scheduler.submit({pubkeys[i], msgs[i].c_str(), sigs[i]}, PRIORITY_HIGH,
+      VerifyScheduler::clock::now() + std::chrono::milliseconds(20));
+    CHECK(high.get());
+    usleep(5000);
+  }
+
+  for(size_t i=0; i < bulk_n; i++) CHECK(bulk[i].get());
+  gettimeofday(&timeEnd, NULL);
+
+  schedulerStats stats = scheduler.stats();
+  cout << "Scheduler, " << bulk_n << " low + " << high_n << " high priority verifications" << endl;
+  cout << "total (microseconds): ";
+  cout << ((timeEnd.tv_sec - timeStart.tv_sec) * 1000000 + timeEnd.tv_usec - timeStart.tv_usec) << endl;
+  cout << "high wait avg/max (microseconds): " << stats.avg_high_wait_us << " / " << stats.max_high_wait_us << endl;
+  cout << "low wait avg/max (microseconds): " << stats.avg_low_wait_us << " / " << stats.max_low_wait_us << endl;
+  cout << "high deadline misses: " << stats.high_deadline_misses << endl;
+  cout << "low batches: " << stats.low_batches << ", avg size " << stats.avg_low_batch_size << endl;
+}
+
+TEST_CASE("Multi-pairing engine", "[bls]") {
+  Bls my_bls = Bls();
+
+  mie::Vuint a("123456789");
+  mie::Vuint b("987654321");
+
+  // e(aQ, bP) * e(-abQ, P) == 1
+  Ec1 neg_p = my_bls.g1;
+  neg_p.p[1] = -neg_p.p[1];
+  std::vector<Ec1> g1_points;
+  std::vector<Ec2> g2_points;
+  g1_points.push_back(my_bls.g1 * b);
+  g2_points.push_back(my_bls.g2 * a);
+  g1_points.push_back(neg_p);
+  g2_points.push_back(my_bls.g2 * (a * b));
+  CHECK(my_bls.multiPairingIsOne(g1_points, g2_points));
+
+  g1_points[0] = my_bls.g1 * a;
+  CHECK_FALSE(my_bls.multiPairingIsOne(g1_points, g2_points));
+
+  // matches the product of separate pairings
+  Fp12 e1, e2;
+  opt_atePairing(e1, g2_points[0], g1_points[0]);
+  opt_atePairing(e2, g2_points[1], g1_points[1]);
+  e1 *= e2;
+  CHECK(my_bls.multiPairing(g1_points, g2_points) == e1);
+
+  // precomputed lines, a worker pool and points at infinity give the same result
+  PubKey ab_pubkey(g2_points[1]);
+  PreparedPubKey prepared(ab_pubkey);
+  std::vector<const std::vector<Fp6>*> lines(2, (const std::vector<Fp6>*)NULL);
+  lines[1] = &prepared.coeff;
+  CHECK(my_bls.multiPairing(g1_points, g2_points, &lines) == e1);
+
+  ThreadPool pool(2);
+  CHECK(my_bls.multiPairing(g1_points, g2_points, NULL, &pool) == e1);
+
+  Ec1 zero;
+  zero.clear();
+  g1_points.push_back(zero);
+  g2_points.push_back(my_bls.g2);
+  CHECK(my_bls.multiPairing(g1_points, g2_points) == e1);
+
+  CHECK(my_bls.multiPairingIsOne(std::vector<Ec1>(), std::vector<Ec2>()));
+
+  g2_points.pop_back();
+  CHECK_THROWS(my_bls.multiPairing(g1_points, g2_points));
+}
+
+TEST_CASE("Benchmark multi-pairing", "[bench]") {
+  size_t iteration_count = 10;
+
+  Bls my_bls = Bls();
+
+  size_t max_n = 64;
+  std::vector<Ec1> g1_points;
+  std::vector<Ec2> g2_points;
+  for(size_t i=0; i < max_n; i++) {
+    g1_points.push_back(my_bls.g1 * mie::Vuint(std::to_string(1000 + i).c_str()));
+    g2_points.push_back(my_bls.g2 * mie::Vuint(std::to_string(2000 + i).c_str()));
+  }
+
+  ThreadPool pool(4);
+
+  cout << "PAIRS     SEPARATE     MULTI     MULTI 4 THREADS (microseconds)" << endl;
+  for(size_t n=2; n <= max_n; n *= 2) {
+    Fp12 out;
+    int separate = (BENCHMARK(
+       { for(size_t j=0; j < n; j++) { opt_atePairing(out, g2_points[j], g1_points[j]); } },
+       iteration_count
+    ));
+    int multi = (BENCHMARK(
+       { out = my_bls.multiPairing(&g1_points[0], &g2_points[0], n); },
+       iteration_count
+    ));
+    int threaded = (BENCHMARK(
+       { out = my_bls.multiPairing(&g1_points[0], &g2_points[0], n, NULL, &pool); },
+       iteration_count
+    ));
+    cout << n << "     " << separate << "     " << multi << "     " << threaded << endl;
+  }
+}
+
+TEST_CASE("Signature sets mix single, aggregate and threshold items", "[bls]") {
+  Bls my_bls = Bls();
+
+  std::vector<std::string> msgs;
+  std::vector<PubKey> pubkeys;
+  std::vector<Sig> sigs;
+  for(size_t i=0; i < 6; i++) {
+    std::string seed = std::to_string(300 + i);
+    msgs.push_back("set message " + std::to_string(i));
+    pubkeys.push_back(my_bls.genPubKey(seed.c_str()));
+    sigs.push_back(my_bls.signMsg(msgs[i].c_str(), seed.c_str(), pubkeys[i]));
+  }
+
+  // aggregate over signers 2..5, signer 2 also appears as a single item
+  std::vector<const char*> agg_msgs;
+  std::vector<PubKey> agg_pubkeys;
+  std::vector<Sig> agg_sigs;
+  for(size_t i=2; i < 6; i++) {
+    agg_msgs.push_back(msgs[i].c_str());
+    agg_pubkeys.push_back(pubkeys[i]);
+    agg_sigs.push_back(sigs[i]);
+  }
+  Sig agg_sig = my_bls.aggregateSigs(agg_sigs);
+
+  // threshold signature combined from shares
+  const char* secret = "12345";
+  const char* thresh_msg = "this is a test message";
+  PubKey group_pubkey = my_bls.genPubKey(secret);
+  std::vector<thresholdPoint> points;
+  my_bls.genThreshKeys(secret, 3, 5, points);
+  std::vector<thresholdSigPoint> shares;
+  for(size_t i=0; i < 3; i++) {
+    shares.push_back({points[i].x, my_bls.signMsg(thresh_msg, points[i].y.get(), group_pubkey)});
+  }
+  Sig thresh_sig = my_bls.combineThresholdSigs(shares, 3);
+
+  SignatureSet set;
+  CHECK(set.addSingle(pubkeys[0], msgs[0].c_str(), sigs[0]) == 0);
+  CHECK(set.addAggregate(agg_msgs, agg_pubkeys, agg_sig) == 1);
+  CHECK(set.addThreshold(group_pubkey, thresh_msg, thresh_sig) == 2);
+  CHECK(set.addSingle(pubkeys[1], msgs[1].c_str(), sigs[1]) == 3);
+  CHECK(set.addSingle(pubkeys[2], msgs[2].c_str(), sigs[2]) == 4);
+  CHECK(set.size() == 5);
+  CHECK(set.kind(1) == SignatureSet::AGGREGATE);
+  CHECK(set.kind(2) == SignatureSet::THRESHOLD);
+
+  std::vector<size_t> bad_items;
+  CHECK(my_bls.verifySignatureSet(set));
+  CHECK(my_bls.verifySignatureSet(set, bad_items));
+  CHECK(bad_items.empty());
+
+  // break the aggregate, the threshold item and one single
+  SignatureSet bad_set;
+  bad_set.addSingle(pubkeys[0], msgs[0].c_str(), sigs[0]);
+  bad_set.addAggregate(agg_msgs, agg_pubkeys, Sig(agg_sig.ec1 + sigs[0].ec1));
+  bad_set.addThreshold(group_pubkey, "another message", thresh_sig);
+  bad_set.addSingle(pubkeys[1], msgs[1].c_str(), sigs[1]);
+  bad_set.addSingle(pubkeys[2], msgs[2].c_str(), sigs[3]);
+
+  CHECK_FALSE(my_bls.verifySignatureSet(bad_set));
+  CHECK_FALSE(my_bls.verifySignatureSet(bad_set, bad_items));
+  REQUIRE(bad_items.size() == 3);
+  CHECK(bad_items[0] == 1);
+  CHECK(bad_items[1] == 2);
+  CHECK(bad_items[2] == 4);
+
+  std::vector<PubKey> too_few(agg_pubkeys.begin(), agg_pubkeys.end() - 1);
+  CHECK_THROWS(set.addAggregate(agg_msgs, too_few, agg_sig));
+
+  set.clear();
+  CHECK(my_bls.verifySignatureSet(set));
+}
+
+TEST_CASE("Benchmark signature set verification", "[bench]") {
+  size_t iteration_count = 5;
+
+  Bls my_bls = Bls();
+
+  // a block with 32 single signatures and 8 aggregates of 8 signers
+  size_t num_singles = 32;
+  size_t num_aggs = 8;
+  size_t agg_size = 8;
+
+  std::vector<std::string> msgs;
+  std::vector<PubKey> pubkeys;
+  std::vector<Sig> sigs;
+  for(size_t i=0; i < num_singles + num_aggs * agg_size; i++) {
+    std::string seed = std::to_string(7000 + i);
+    msgs.push_back("block message " + std::to_string(i));
+    pubkeys.push_back(my_bls.genPubKey(seed.c_str()));
+    sigs.push_back(my_bls.signMsg(msgs[i].c_str(), seed.c_str(), pubkeys[i]));
+  }
+
+  SignatureSet set;
+  for(size_t i=0; i < num_singles; i++) {
+    set.addSingle(pubkeys[i], msgs[i].c_str(), sigs[i]);
+  }
+
+  std::vector<std::vector<const char*> > agg_msgs(num_aggs);
+  std::vector<std::vector<PubKey> > agg_pubkeys(num_aggs);
+  std::vector<Sig> agg_sigs;
+  for(size_t a=0; a < num_aggs; a++) {
+    std::vector<Sig> parts;
+    for(size_t j=0; j < agg_size; j++) {
+      size_t i = num_singles + a * agg_size + j;
+      agg_msgs[a].push_back(msgs[i].c_str());
+      agg_pubkeys[a].push_back(pubkeys[i]);
+      parts.push_back(sigs[i]);
+    }
+    agg_sigs.push_back(my_bls.aggregateSigs(parts));
+    set.addAggregate(agg_msgs[a], agg_pubkeys[a], agg_sigs[a]);
+  }
+
+  int separate = (BENCHMARK(
+     {
+       for(size_t i=0; i < num_singles; i++) { my_bls.verifySig(pubkeys[i], msgs[i].c_str(), sigs[i]); }
+       for(size_t a=0; a < num_aggs; a++) { my_bls.verifyAggSig(agg_msgs[a], agg_pubkeys[a], agg_sigs[a]); }
+     },
+     iteration_count
+  ));
+  int combined = (BENCHMARK(
+     { my_bls.verifySignatureSet(set); },
+     iteration_count
+  ));
+
+  cout << "Block of " << num_singles << " singles + " << num_aggs << " aggregates of " << agg_size << endl;
+  cout << "separate calls (microseconds): " << separate << endl;
+  cout << "Bls::verifySignatureSet (microseconds): " << combined << endl;
+}
+
+TEST_CASE("Optimistic aggregation pool", "[bls]") {
+  Bls my_bls = Bls();
+
+  std::vector<std::string> msgs;
+  std::vector<PubKey> pubkeys;
+  std::vector<Sig> sigs;
+  for(size_t i=0; i < 10; i++) {
+    std::string seed = std::to_string(400 + i);
+    msgs.push_back("slot attestation " + std::to_string(i));
+    pubkeys.push_back(my_bls.genPubKey(seed.c_str()));
+    sigs.push_back(my_bls.signMsg(msgs[i].c_str(), seed.c_str(), pubkeys[i]));
+  }
+
+  std::vector<poolFlush> flushes;
+  aggregationPoolConfig config = {4, 60000000};
+  AggregationPool pool(my_bls, config, [&flushes](const poolFlush &f) { flushes.push_back(f); });
+
+  // a full pool of valid signatures takes the optimistic path
+  for(size_t i=0; i < 4; i++) {
+    CHECK(pool.add(pubkeys[i], msgs[i].c_str(), sigs[i]));
+  }
+  REQUIRE(flushes.size() == 1);
+  CHECK(flushes[0].optimistic);
+  CHECK(flushes[0].included.size() == 4);
+  CHECK(flushes[0].rejected.empty());
+  CHECK(pool.size() == 0);
+
+  std::vector<const char*> agg_msgs;
+  std::vector<PubKey> agg_pubkeys;
+  for(size_t i=0; i < 4; i++) {
+    agg_msgs.push_back(flushes[0].included[i].msg.c_str());
+    agg_pubkeys.push_back(flushes[0].included[i].pubkey);
+  }
+  CHECK(my_bls.verifyAggSig(agg_msgs, agg_pubkeys, Sig(flushes[0].agg_sig)));
+
+  // duplicates are dropped, an invalid signature forces the fallback
+  CHECK(pool.add(pubkeys[4], msgs[4].c_str(), sigs[4]));
+  CHECK_FALSE(pool.add(pubkeys[4], msgs[4].c_str(), sigs[4]));
+  CHECK(pool.add(pubkeys[5], msgs[5].c_str(), sigs[6]));
+  CHECK(pool.size() == 2);
+  pool.flush();
+
+  REQUIRE(flushes.size() == 2);
+  CHECK_FALSE(flushes[1].optimistic);
+  REQUIRE(flushes[1].included.size() == 1);
+  REQUIRE(flushes[1].rejected.size() == 1);
+  CHECK(flushes[1].rejected[0].msg == msgs[5]);
+  CHECK(flushes[1].agg_sig == sigs[4].ec1);
+
+  // age based flush
+  aggregationPoolConfig short_config = {100, 1000};
+  std::vector<poolFlush> timed;
+  AggregationPool timed_pool(my_bls, short_config, [&timed](const poolFlush &f) { timed.push_back(f); });
+  CHECK(timed_pool.add(pubkeys[7], msgs[7].c_str(), sigs[7]));
+  CHECK_FALSE(timed_pool.poll());
+  usleep(2000);
+  CHECK(timed_pool.poll());
+  CHECK(timed.size() == 1);
+
+  aggregationPoolStats stats = pool.stats();
+  CHECK(stats.flushes == 2);
+  CHECK(stats.optimistic_successes == 1);
+  CHECK(stats.fallbacks == 1);
+  CHECK(stats.duplicates == 1);
+  CHECK(stats.rejected == 1);
+  CHECK(stats.optimistic_rate == 0.5);
+}
+
+TEST_CASE("Benchmark optimistic aggregation", "[bench]") {
+  size_t iteration_count = 5;
+
+  Bls my_bls = Bls();
+
+  size_t n = 64;
+  std::vector<std::string> msgs;
+  std::vector<PubKey> pubkeys;
+  std::vector<Sig> sigs;
+  for(size_t i=0; i < n; i++) {
+    std::string seed = std::to_string(9000 + i);
+    msgs.push_back("slot attestation " + std::to_string(i));
+    pubkeys.push_back(my_bls.genPubKey(seed.c_str()));
+    sigs.push_back(my_bls.signMsg(msgs[i].c_str(), seed.c_str(), pubkeys[i]));
+  }
+
+  aggregationPoolConfig config = {n, 60000000};
+  AggregationPool pool(my_bls, config, [](const poolFlush &) {});
+
+  int individual = (BENCHMARK(
+     { for(size_t i=0; i < n; i++) { my_bls.verifySig(pubkeys[i], msgs[i].c_str(), sigs[i]); } },
+     iteration_count
+  ));
+  int optimistic = (BENCHMARK(
+     { for(size_t i=0; i < n; i++) { pool.add(pubkeys[i], msgs[i].c_str(), sigs[i]); } },
+     iteration_count
+  ));
+  int with_bad = (BENCHMARK(
+     { for(size_t i=0; i < n; i++) { pool.add(pubkeys[i], msgs[i].c_str(), sigs[i == 7 ? 8 : i]); } },
+     iteration_count
+  ));
+
+  cout << n << " signatures per slot" << endl;
+  cout << "individual verifySig (microseconds): " << individual << endl;
+  cout << "pool, all valid (microseconds): " << optimistic << endl;
+  cout << "pool, one invalid (microseconds): " << with_bad << endl;
+  cout << "optimistic rate: " << pool.stats().optimistic_rate << endl;
+}
+
+TEST_CASE("Batch verification for a single signer", "[bls]") {
+  Bls my_bls = Bls();
+
+  const char *seed = "15267802884793550383558706039165621050290089775961208824303765753922461897946";
+  PubKey pubkey = my_bls.genPubKey(seed);
+  PreparedPubKey prepared(pubkey);
+
+  std::vector<std::string> msg_strs;
+  std::vector<const char*> msgs;
+  std::vector<Sig> sigs;
+  for(size_t i=0; i < 9; i++) {
+    msg_strs.push_back("oracle price update " + std::to_string(i));
+  }
+  for(size_t i=0; i < msg_strs.size(); i++) {
+    msgs.push_back(msg_strs[i].c_str());
+    sigs.push_back(my_bls.signMsg(msgs[i], seed, pubkey));
+  }
+
+  std::vector<size_t> bad_indices;
+  CHECK(my_bls.verifySameSigner(pubkey, msgs, sigs));
+  CHECK(my_bls.verifySameSigner(prepared, msgs, sigs));
+  CHECK(my_bls.verifySameSigner(pubkey, msgs, sigs, bad_indices));
+  CHECK(bad_indices.empty());
+
+  // swapping two signatures keeps the sum of signatures but breaks the window
+  std::vector<Sig> bad_sigs = sigs;
+  std::swap(bad_sigs[2], bad_sigs[6]);
+  CHECK_FALSE(my_bls.verifySameSigner(pubkey, msgs, bad_sigs));
+  CHECK_FALSE(my_bls.verifySameSigner(prepared, msgs, bad_sigs));
+  CHECK_FALSE(my_bls.verifySameSigner(pubkey, msgs, bad_sigs, bad_indices));
+  REQUIRE(bad_indices.size() == 2);
+  CHECK(bad_indices[0] == 2);
+  CHECK(bad_indices[1] == 6);
+
+  // signatures by another key
+  PubKey other = my_bls.genPubKey("42");
+  CHECK_FALSE(my_bls.verifySameSigner(other, msgs, sigs));
+
+  CHECK(my_bls.verifySameSigner(pubkey, std::vector<const char*>(), std::vector<Sig>()));
+  msgs.pop_back();
+  CHECK_THROWS(my_bls.verifySameSigner(pubkey, msgs, sigs));
+}
+
+TEST_CASE("Benchmark single signer batch verification", "[bench]") {
+  Bls my_bls = Bls();
+
+  const char *seed = "15267802884793550383558706039165621050290089775961208824303765753922461897946";
+  PubKey pubkey = my_bls.genPubKey(seed);
+  PreparedPubKey prepared(pubkey);
+
+  size_t max_n = 4096;
+  std::vector<std::string> msg_strs;
+  std::vector<const char*> msgs;
+  std::vector<Sig> sigs;
+  for(size_t i=0; i < max_n; i++) {
+    msg_strs.push_back("oracle price update " + std::to_string(i));
+  }
+  for(size_t i=0; i < max_n; i++) {
+    msgs.push_back(msg_strs[i].c_str());
+    sigs.push_back(my_bls.signMsg(msgs[i], seed, pubkey));
+  }
+
+  cout << "WINDOW     VERIFYSIG LOOP     SAME SIGNER     PREPARED (microseconds)" << endl;
+  for(size_t n=2; n <= max_n; n *= 2) {
+    size_t iteration_count = n <= 64 ? 10 : 1;
+    std::vector<const char*> window_msgs(msgs.begin(), msgs.begin() + n);
+    std::vector<Sig> window_sigs(sigs.begin(), sigs.begin() + n);
+
+    int loop = (BENCHMARK(
+       { for(size_t j=0; j < n; j++) { my_bls.verifySig(pubkey, window_msgs[j], window_sigs[j]); } },
+       iteration_count
+    ));
+    int batched = (BENCHMARK(
+       { my_bls.verifySameSigner(pubkey, window_msgs, window_sigs); },
+       iteration_count
+    ));
+    int batched_prepared = (BENCHMARK(
+       { my_bls.verifySameSigner(prepared, window_msgs, window_sigs); },
+       iteration_count
+    ));
+    cout << n << "     " << loop << "     " << batched << "     " << batched_prepared << endl;
+  }
+}
+
+TEST_CASE("SvdW hashing suite", "[bls]") {
+  Bls my_bls = Bls();
+  CHECK(my_bls.getHashSuite() == HASH_TRY_AND_INCREMENT);
+
+  const char *seed = "15267802884793550383558706039165621050290089775961208824303765753922461897946";
+  PubKey pubkey = my_bls.genPubKey(seed);
+  const char *msg = "That's how the cookie crumbles";
+
+  Ec1 legacy_point = my_bls.hashMsgWithPubkey(msg, pubkey.ec2);
+  Sig legacy_sig = my_bls.signMsg(msg, seed, pubkey);
+
+  my_bls.setHashSuite(HASH_SVDW);
+  Ec1 svdw_point = my_bls.hashMsgWithPubkey(msg, pubkey.ec2);
+
+  // deterministic, on the curve and different from the old map
+  CHECK(svdw_point == my_bls.hashMsgWithPubkey(msg, pubkey.ec2));
+  CHECK_FALSE(svdw_point == legacy_point);
+  CHECK_FALSE(svdw_point == my_bls.hashMsgWithPubkey("another message", pubkey.ec2));
+  Ec1 normalized = svdw_point;
+  normalized.normalize();
+  CHECK(normalized.p[1] * normalized.p[1] == normalized.p[0] * normalized.p[0] * normalized.p[0] + CURVE_B);
+
+  // signatures only verify under the suite they were made with
+  Sig svdw_sig = my_bls.signMsg(msg, seed, pubkey);
+  CHECK(my_bls.verifySig(pubkey, msg, svdw_sig));
+  CHECK_FALSE(my_bls.verifySig(pubkey, msg, legacy_sig));
+
+  // the cache keeps the suites apart
+  my_bls.setVerifyCache(std::make_shared<VerifyCache>(16));
+  CHECK(my_bls.verifySig(pubkey, msg, svdw_sig));
+  my_bls.setHashSuite(HASH_TRY_AND_INCREMENT);
+  CHECK_FALSE(my_bls.verifySig(pubkey, msg, svdw_sig));
+  CHECK(my_bls.verifySig(pubkey, msg, legacy_sig));
+}
+
+TEST_CASE("Benchmark hash to curve cost distribution", "[bench]") {
+  size_t iteration_count = 2000;
+
+  Bls my_bls = Bls();
+  PubKey pubkey = my_bls.genPubKey("15267802884793550383558706039165621050290089775961208824303765753922461897946");
+
+  std::vector<std::string> msgs;
+  for(size_t i=0; i < iteration_count; i++) {
+    msgs.push_back("hash distribution message " + std::to_string(i));
+  }
+
+  HashSuite suites[2] = {HASH_TRY_AND_INCREMENT, HASH_SVDW};
+  const char *names[2] = {"try and increment", "SvdW             "};
+
+  cout << "MAP                  MIN (us)   P50 (us)   P99 (us)   MAX (us)" << endl;
+  for(size_t s=0; s < 2; s++) {
+    my_bls.setHashSuite(suites[s]);
+
+    size_t next = 0;
+    std::vector<long> latencies = measure_latencies([&]() {
+      my_bls.hashMsgWithPubkey(msgs[next++].c_str(), pubkey.ec2);
+    }, iteration_count);
+
+    cout << names[s] << "    " << latencies[0] << "         " << latencies[iteration_count / 2] << "         ";
+    cout << latencies[iteration_count * 99 / 100] << "         " << latencies[iteration_count - 1] << endl;
+  }
+}
+
+TEST_CASE("Byte oriented mapHashOntoCurve matches the hex string map", "[bls]") {
+  Bls my_bls = Bls();
+
+  for(size_t i=0; i < 200; i++) {
+    unsigned char digest[SHA256::DIGEST_SIZE];
+    std::string input = "digest input " + std::to_string(i);
+    SHA256 ctx = SHA256();
+    ctx.init();
+    ctx.update((unsigned char*)input.c_str(), input.length());
+    ctx.final(digest);
+
+    // short digests exercise the bit length computation
+    if(i % 10 == 0) memset(digest, 0, 8 + i / 10);
+
+    char hex[2 * SHA256::DIGEST_SIZE + 3] = "0x";
+    for(size_t j=0; j < SHA256::DIGEST_SIZE; j++) {
+      sprintf(hex + 2 + 2 * j, "%02x", digest[j]);
+    }
+
+    CHECK(my_bls.mapHashOntoCurve((const uint8_t*)digest) == my_bls.mapHashOntoCurve(hex));
+  }
+}
+
+TEST_CASE("Benchmark byte oriented mapHashOntoCurve", "[bench]") {
+  size_t iteration_count = 2000;
+
+  Bls my_bls = Bls();
+
+  std::vector<std::vector<unsigned char> > digests;
+  for(size_t i=0; i < iteration_count; i++) {
+    unsigned char digest[SHA256::DIGEST_SIZE];
+    std::string input = "digest input " + std::to_string(i);
+    SHA256 ctx = SHA256();
+    ctx.init();
+    ctx.update((unsigned char*)input.c_str(), input.length());
+    ctx.final(digest);
+    digests.push_back(std::vector<unsigned char>(digest, digest + SHA256::DIGEST_SIZE));
+  }
+
+  struct timeval timeStart, timeEnd;
+
+  // the old pipeline: format the digest as hex, then parse it back
+  gettimeofday(&timeStart, NULL);
+  for(size_t i=0; i < iteration_count; i++) {
+    char hex[2 * SHA256::DIGEST_SIZE + 3] = "0x";
+    for(size_t j=0; j < SHA256::DIGEST_SIZE; j++) {
+      sprintf(hex + 2 + 2 * j, "%02x", digests[i][j]);
+    }
+    my_bls.mapHashOntoCurve(hex);
+  }
+  gettimeofday(&timeEnd, NULL);
+  long hex_time = (timeEnd.tv_sec - timeStart.tv_sec) * 1000000 + timeEnd.tv_usec - timeStart.tv_usec;
+
+  gettimeofday(&timeStart, NULL);
+  for(size_t i=0; i < iteration_count; i++) {
+    my_bls.mapHashOntoCurve((const uint8_t*)&digests[i][0]);
+  }
+  gettimeofday(&timeEnd, NULL);
+  long byte_time = (timeEnd.tv_sec - timeStart.tv_sec) * 1000000 + timeEnd.tv_usec - timeStart.tv_usec;
+
+  cout << "hex string mapHashOntoCurve (microseconds): " << hex_time / (long)iteration_count << endl;
+  cout << "byte mapHashOntoCurve (microseconds): " << byte_time / (long)iteration_count << endl;
+}
+
+TEST_CASE("Prepared keys hash messages from a cached SHA256 midstate", "[bls]") {
+  Bls my_bls = Bls();
+
+  const char *seed = "15267802884793550383558706039165621050290089775961208824303765753922461897946";
+  PubKey pubkey = my_bls.genPubKey(seed);
+  PreparedPubKey prepared(pubkey);
+
+  // long messages cross SHA256 block boundaries after the prefix
+  std::vector<std::string> msgs;
+  msgs.push_back("");
+  msgs.push_back("That's how the cookie crumbles");
+  msgs.push_back(std::string(200, 'x'));
+
+  HashSuite suites[2] = {HASH_TRY_AND_INCREMENT, HASH_SVDW};
+  for(size_t s=0; s < 2; s++) {
+    my_bls.setHashSuite(suites[s]);
+    for(size_t i=0; i < msgs.size(); i++) {
+      CHECK(my_bls.hashMsgWithPubkey(msgs[i].c_str(), prepared) == my_bls.hashMsgWithPubkey(msgs[i].c_str(), pubkey.ec2));
+      CHECK(my_bls.verifySig(prepared, msgs[i].c_str(), my_bls.signMsg(msgs[i].c_str(), seed, pubkey)));
+    }
+  }
+}
+
+TEST_CASE("Benchmark hashing with a cached pubkey midstate", "[bench]") {
+  size_t iteration_count = 2000;
+
+  Bls my_bls = Bls();
+  PubKey pubkey = my_bls.genPubKey("15267802884793550383558706039165621050290089775961208824303765753922461897946");
+  PreparedPubKey prepared(pubkey);
+  const char *msg = "That's how the cookie crumbles";
+
+  int plain = (BENCHMARK((my_bls.hashMsgWithPubkey(msg, pubkey.ec2)), iteration_count));
+  int cached = (BENCHMARK((my_bls.hashMsgWithPubkey(msg, prepared)), iteration_count));
+
+  cout << "hashMsgWithPubkey with Ec2 (microseconds): " << plain << endl;
+  cout << "hashMsgWithPubkey with PreparedPubKey (microseconds): " << cached << endl;
+
+  // the prefix alone, which the midstate saves on every call
+  struct timeval timeStart, timeEnd;
+  gettimeofday(&timeStart, NULL);
+  for(size_t i=0; i < iteration_count; i++) {
+    Bls::pubkeyHashPrefix(pubkey.ec2);
+  }
+  gettimeofday(&timeEnd, NULL);
+
+  cout << "pubkey prefix alone (nanoseconds): ";
+  cout << ((timeEnd.tv_sec - timeStart.tv_sec) * 1000000 + timeEnd.tv_usec - timeStart.tv_usec) * 1000 / iteration_count;
+  cout << endl;
+}
+
+TEST_CASE("Binary messages with embedded NUL bytes", "[bls]") {
+  Bls my_bls = Bls();
+
+  std::vector<PubKey> pubkeys;
+  std::vector<mie::Vuint> secret_keys;
+  for(size_t i=0; i < 4; i++) {
+    secret_keys.push_back(mie::Vuint(1000 + i));
+    pubkeys.push_back(my_bls.genPubKey(secret_keys[i]));
+  }
+
+  // messages packed into one arena, the second one is empty
+  const uint8_t packet[] = {'a', 0, 'b', 'x', 0, 0, 'y', 0xff, 0};
+  const size_t offsets[] = {0, 3, 3, 6, 9};
+  msgArena arena = {packet, offsets, 4};
+
+  std::vector<Sig> sigs;
+  for(size_t i=0; i < 4; i++) {
+    sigs.push_back(my_bls.signMsg(packet + offsets[i], offsets[i + 1] - offsets[i], secret_keys[i], pubkeys[i]));
+    CHECK(my_bls.verifySig(pubkeys[i], packet + offsets[i], offsets[i + 1] - offsets[i], sigs[i]));
+  }
+
+  // the bytes after a NUL are signed too
+  CHECK_FALSE(my_bls.verifySig(pubkeys[0], "a", sigs[0]));
+  CHECK_FALSE(my_bls.verifySig(pubkeys[0], packet, 2, sigs[0]));
+
+  // without NUL bytes every overload signs the same bytes
+  std::string text = "That's how the cookie crumbles";
+  Sig text_sig = my_bls.signMsg(text.c_str(), secret_keys[0], pubkeys[0]);
+  CHECK(my_bls.verifySig(pubkeys[0], text, text_sig));
+  CHECK(my_bls.verifySig(pubkeys[0], (const uint8_t*)text.data(), text.size(), text_sig));
+  CHECK(my_bls.signMsg(text, secret_keys[0], pubkeys[0]).ec1 == text_sig.ec1);
+
+  Sig agg_sig = my_bls.aggregateSigs(sigs);
+  CHECK(my_bls.verifyAggSig(arena, pubkeys, agg_sig));
+  CHECK(my_bls.verifyBatch(arena, pubkeys, sigs));
+
+  std::vector<Sig> bad_sigs = sigs;
+  bad_sigs[2] = sigs[3];
+  std::vector<size_t> bad_indices;
+  CHECK_FALSE(my_bls.verifyAggSig(arena, pubkeys, my_bls.aggregateSigs(bad_sigs)));
+  CHECK_FALSE(my_bls.verifyBatch(arena, pubkeys, bad_sigs, bad_indices));
+  CHECK(bad_indices == std::vector<size_t>(1, 2));
+
+  // streamed records keep their NUL bytes
+  std::stringstream records;
+  for(size_t i=0; i < 4; i++) {
+    my_bls.writeAggRecord(records, pubkeys[i], packet + offsets[i], offsets[i + 1] - offsets[i]);
+  }
+  CHECK(my_bls.verifyAggSigStream(records, agg_sig));
+
+  const size_t bad_offsets[] = {0, 3, 2, 6, 9};
+  msgArena bad_arena = {packet, bad_offsets, 4};
+  CHECK_THROWS(my_bls.verifyAggSig(bad_arena, pubkeys, agg_sig));
+  CHECK_THROWS(my_bls.verifyBatch(arena, pubkeys, std::vector<Sig>(sigs.begin(), sigs.begin() + 3)));
+}
+
+TEST_CASE("Binary messages through prepared keys, same signer windows and queues", "[bls]") {
+  Bls my_bls = Bls();
+
+  std::vector<PubKey> pubkeys;
+  std::vector<const PreparedPubKey*> prepared;
+  std::vector<PreparedPubKey> prepared_keys;
+  std::vector<mie::Vuint> secret_keys;
+  for(size_t i=0; i < 4; i++) {
+    secret_keys.push_back(mie::Vuint(2000 + i));
+    pubkeys.push_back(my_bls.genPubKey(secret_keys[i]));
+    prepared_keys.push_back(PreparedPubKey(pubkeys[i]));
+  }
+  for(size_t i=0; i < 4; i++) prepared.push_back(&prepared_keys[i]);
+
+  const uint8_t packet[] = {'a', 0, 'b', 'x', 0, 0, 'y', 0xff, 0};
+  const size_t offsets[] = {0, 3, 3, 6, 9};
+  msgArena arena = {packet, offsets, 4};
+
+  std::vector<Sig> sigs;
+  std::vector<Sig> own_sigs;  // every message signed by the first key
+  for(size_t i=0; i < 4; i++) {
+    sigs.push_back(my_bls.signMsg(packet + offsets[i], offsets[i + 1] - offsets[i], secret_keys[i], pubkeys[i]));
+    own_sigs.push_back(my_bls.signMsg(packet + offsets[i], offsets[i + 1] - offsets[i], secret_keys[0], pubkeys[0]));
+  }
+  Sig agg_sig = my_bls.aggregateSigs(sigs);
+
+  CHECK(my_bls.verifySig(prepared_keys[0], packet, 3, sigs[0]));
+  CHECK(my_bls.verifySig(prepared_keys[0], std::string((const char*)packet, 3), sigs[0]));
+  CHECK_FALSE(my_bls.verifySig(prepared_keys[0], "a", sigs[0]));
+  CHECK(my_bls.verifySigSignAgnostic(pubkeys[0], packet, 3, sigs[0]));
+  CHECK(my_bls.verifySigLowLatency(pubkeys[0], packet, 3, sigs[0]));
+
+  CHECK(my_bls.verifyAggSig(arena, prepared, agg_sig));
+  CHECK(my_bls.verifyAggSig(arena, prepared, agg_sig, false, false));
+  CHECK(my_bls.verifyAggSig(arena, pubkeys, agg_sig, false, true));
+  pipelineConfig config = {2, 2, 4};
+  CHECK(my_bls.verifyAggSig(arena, pubkeys, agg_sig, config));
+  CHECK_FALSE(my_bls.verifyAggSig(arena, pubkeys, sigs[0], config));
+
+  PartialProduct first = my_bls.aggPartialProduct(arena, pubkeys, 0, 2);
+  PartialProduct second = my_bls.aggPartialProduct(arena, pubkeys, 2, 4);
+  CHECK(my_bls.verifyAggPartials(std::vector<PartialProduct>{first, second}, agg_sig));
+
+  CHECK(my_bls.verifySameSigner(pubkeys[0], arena, own_sigs));
+  CHECK(my_bls.verifySameSigner(prepared_keys[0], arena, own_sigs));
+  std::vector<Sig> bad_own_sigs = own_sigs;
+  bad_own_sigs[1] = own_sigs[3];
+  std::vector<size_t> bad_indices;
+  CHECK_FALSE(my_bls.verifySameSigner(pubkeys[0], arena, bad_own_sigs, bad_indices));
+  CHECK(bad_indices == std::vector<size_t>{1});
+
+  SignatureSet set;
+  set.addSingle(pubkeys[1], packet + 3, 3, sigs[2]);
+  CHECK_FALSE(my_bls.verifySignatureSet(set));
+  set.clear();
+  set.addSingle(pubkeys[0], packet, 3, sigs[0]);
+  set.addAggregate(arena, pubkeys, agg_sig);
+  set.addThreshold(pubkeys[3], packet + 6, 3, sigs[3]);
+  CHECK(my_bls.verifySignatureSet(set));
+
+  VerifyScheduler scheduler(my_bls);
+  std::future<bool> single = scheduler.submit(pubkeys[0], packet, 3, sigs[0], PRIORITY_HIGH);
+  std::future<bool> truncated = scheduler.submit(pubkeys[0], packet, 1, sigs[0], PRIORITY_LOW);
+  std::future<bool> agg = scheduler.submitAgg(arena, pubkeys, agg_sig, PRIORITY_LOW);
+  CHECK(single.get());
+  CHECK_FALSE(truncated.get());
+  CHECK(agg.get());
+
+  std::vector<poolFlush> flushes;
+  aggregationPoolConfig pool_config = {4, 60000000};
+  AggregationPool pool(my_bls, pool_config, [&flushes](const poolFlush &f) { flushes.push_back(f); });
+  for(size_t i=0; i < 4; i++) {
+    CHECK(pool.add(pubkeys[i], packet + offsets[i], offsets[i + 1] - offsets[i], sigs[i]));
+  }
+  REQUIRE(flushes.size() == 1);
+  CHECK(flushes[0].optimistic);
+  CHECK(flushes[0].included[0].msg == std::string((const char*)packet, 3));
+
+  AggVerifier verifier(my_bls);
+  for(size_t i=0; i < 4; i++) {
+    verifier.add(pubkeys[i], packet + offsets[i], offsets[i + 1] - offsets[i], sigs[i]);
+  }
+  CHECK(verifier.check());
+  verifier.remove(pubkeys[2], packet + offsets[2], offsets[3] - offsets[2], sigs[2]);
+  CHECK(verifier.check());
+  // the truncated message hashes differently, so it does not cancel the signer
+  verifier.remove(pubkeys[0], "a", sigs[0]);
+  CHECK_FALSE(verifier.check());
+
+  // arena overloads throw on a count mismatch instead of returning false
+  std::vector<PubKey> three_pubkeys(pubkeys.begin(), pubkeys.begin() + 3);
+  std::vector<const PreparedPubKey*> three_prepared(prepared.begin(), prepared.begin() + 3);
+  CHECK_THROWS_AS(my_bls.verifyAggSig(arena, three_pubkeys, agg_sig), std::invalid_argument&);
+  CHECK_THROWS_AS(my_bls.verifyAggSig(arena, three_prepared, agg_sig), std::invalid_argument&);
+  CHECK_THROWS_AS(my_bls.verifyAggSig(arena, three_pubkeys, agg_sig, config), std::invalid_argument&);
+  CHECK_THROWS_AS(my_bls.aggPartialProduct(arena, three_pubkeys, 0, 3), std::invalid_argument&);
+  CHECK_THROWS_AS(my_bls.verifySameSigner(pubkeys[0], arena, std::vector<Sig>(3, own_sigs[0])), std::invalid_argument&);
+  CHECK_THROWS_AS(set.addAggregate(arena, three_pubkeys, agg_sig), std::invalid_argument&);
+}
+
+TEST_CASE("Benchmark aggregate verification from a message arena", "[bench]") {
+  size_t num_msgs = 64;
+  size_t msg_len = 512;
+  size_t iteration_count = 3;
+
+  Bls my_bls = Bls();
+
+  // one network buffer holding every message back to back
+  std::vector<uint8_t> packet(num_msgs * msg_len);
+  for(size_t i=0; i < packet.size(); i++) packet[i] = 'a' + i % 26;
+  std::vector<size_t> offsets;
+  for(size_t i=0; i <= num_msgs; i++) offsets.push_back(i * msg_len);
+  msgArena arena = {&packet[0], &offsets[0], num_msgs};
+
+  std::vector<PubKey> pubkeys;
+  std::vector<Sig> sigs;
+  for(size_t i=0; i < num_msgs; i++) {
+    mie::Vuint secret_key(1000 + i);
+    pubkeys.push_back(my_bls.genPubKey(secret_key));
+    sigs.push_back(my_bls.signMsg(&packet[offsets[i]], msg_len, secret_key, pubkeys[i]));
+  }
+  Sig agg_sig = my_bls.aggregateSigs(sigs);
+
+  // what callers had to do before: copy every message into its own C string
+  int copied = (BENCHMARK({
+    std::vector<std::string> msg_strs;
+    std::vector<const char*> msgs;
+    for(size_t i=0; i < num_msgs; i++) msg_strs.push_back(std::string((const char*)&packet[offsets[i]], msg_len));
+    for(size_t i=0; i < num_msgs; i++) msgs.push_back(msg_strs[i].c_str());
+    my_bls.verifyAggSig(msgs, pubkeys, agg_sig);
+  }, iteration_count));
+
+  int in_place = (BENCHMARK((my_bls.verifyAggSig(arena, pubkeys, agg_sig)), iteration_count));
+
+  cout << "aggregate verification of " << num_msgs << " copied messages (microseconds): " << copied << endl;
+  cout << "aggregate verification from the arena (microseconds): " << in_place << endl;
+}
+
+TEST_CASE("Multi-buffer SHA256 matches the scalar hash", "[bls]") {
+  // prefixes and messages of many lengths so lanes finish at different blocks
+  size_t n = 37;
+  std::vector<SHA256> states(n);
+  std::vector<std::string> msgs(n);
+  std::vector<const SHA256*> state_ptrs;
+  std::vector<const unsigned char*> msg_ptrs;
+  std::vector<size_t> lens;
+  for(size_t i=0; i < n; i++) {
+    std::string prefix(i * 7 % 100, 'p');
+    states[i].init();
+    states[i].update((const unsigned char*)prefix.data(), prefix.size());
+
+    for(size_t j=0; j < i * 13 % 200; j++) msgs[i].push_back((char)(i * 31 + j));
+    state_ptrs.push_back(&states[i]);
+    msg_ptrs.push_back((const unsigned char*)msgs[i].data());
+    lens.push_back(msgs[i].size());
+  }
+
+  size_t max_lanes[3] = {1, 8, 16};
+  for(size_t l=0; l < 3; l++) {
+    std::vector<unsigned char> digests(n * SHA256::DIGEST_SIZE);
+    unsigned int used = SHA256::hashMany(&state_ptrs[0], &msg_ptrs[0], &lens[0], n, &digests[0], max_lanes[l]);
+    CHECK(used <= max_lanes[l]);
+    CHECK(used <= SHA256::lanes());
+
+    for(size_t i=0; i < n; i++) {
+      SHA256 ctx = states[i];
+      ctx.update((const unsigned char*)msgs[i].data(), msgs[i].size());
+      unsigned char digest[SHA256::DIGEST_SIZE];
+      ctx.final(digest);
+      CHECK(memcmp(digest, &digests[i * SHA256::DIGEST_SIZE], SHA256::DIGEST_SIZE) == 0);
+    }
+  }
+
+  // the batch and aggregate paths hash through hashMany
+  Bls my_bls = Bls();
+  std::vector<PubKey> pubkeys;
+  std::vector<Sig> sigs;
+  std::vector<const char*> agg_msgs;
+  std::vector<sigTriple> triples;
+  for(size_t i=0; i < 20; i++) {
+    mie::Vuint secret_key(2000 + i % 5);
+    pubkeys.push_back(my_bls.genPubKey(secret_key));
+    agg_msgs.push_back(msgs[i + 1].c_str());
+    sigs.push_back(my_bls.signMsg(agg_msgs[i], secret_key, pubkeys[i]));
+  }
+  for(size_t i=0; i < 20; i++) triples.push_back({pubkeys[i], agg_msgs[i], sigs[i]});
+
+  CHECK(my_bls.verifyAggSig(agg_msgs, pubkeys, my_bls.aggregateSigs(sigs)));
+  CHECK(my_bls.verifyBatch(triples));
+  CHECK(my_bls.verifySameSigner(pubkeys[0], std::vector<const char*>(1, agg_msgs[0]), std::vector<Sig>(1, sigs[0])));
+}
+
+TEST_CASE("Benchmark multi-buffer SHA256 throughput by message size", "[bench]") {
+  size_t n = 1024;
+  size_t iteration_count = 20;
+  size_t msg_sizes[5] = {32, 64, 128, 512, 4096};
+
+  cout << "SHA256 engine lanes on this CPU: " << SHA256::lanes() << endl;
+
+  for(size_t s=0; s < 5; s++) {
+    // pubkey sized prefix absorbed first, as in hashMsgWithPubkey
+    std::string prefix(77, 'p');
+    SHA256 state;
+    state.init();
+    state.update((const unsigned char*)prefix.data(), prefix.size());
+
+    std::string msg(msg_sizes[s], 'm');
+    std::vector<const SHA256*> state_ptrs(n, &state);
+    std::vector<const unsigned char*> msg_ptrs(n, (const unsigned char*)msg.data());
+    std::vector<size_t> lens(n, msg.size());
+    std::vector<unsigned char> digests(n * SHA256::DIGEST_SIZE);
+
+    size_t max_lanes[3] = {1, 8, 16};
+    for(size_t l=0; l < 3; l++) {
+      if(max_lanes[l] > SHA256::lanes()) continue;
+
+      struct timeval timeStart, timeEnd;
+      gettimeofday(&timeStart, NULL);
+      for(size_t i=0; i < iteration_count; i++) {
+        SHA256::hashMany(&state_ptrs[0], &msg_ptrs[0], &lens[0], n, &digests[0], max_lanes[l]);
+      }
+      gettimeofday(&timeEnd, NULL);
+      double us = (timeEnd.tv_sec - timeStart.tv_sec) * 1000000.0 + timeEnd.tv_usec - timeStart.tv_usec;
+
+      cout << msg_sizes[s] << " byte messages, " << max_lanes[l] << " lanes (MB/s): ";
+      cout << n * iteration_count * msg_sizes[s] / us << endl;
+    }
+  }
+}
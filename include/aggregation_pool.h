@@ -0,0 +1,114 @@
+/*
+ * Optimistic aggregation of incoming single signatures
+ * Signatures are collected, summed into one aggregate and checked with a single aggregate
+ * verification. Only when that check fails is the batch bisected to drop the invalid signatures
+ */
+
+#ifndef BLS_AGGREGATION_POOL
+#define BLS_AGGREGATION_POOL
+
+#include "bls.h"
+#include <vector>
+#include <string>
+#include <unordered_set>
+#include <functional>
+#include <chrono>
+#include <stdint.h>
+
+namespace bls {
+  /*
+   * Flush limits of an AggregationPool
+   */
+  typedef struct aggregationPoolConfig {
+    size_t max_size;      // flush once this many signatures are pending
+    uint64_t max_age_us;  // flush once the oldest pending signature is this old
+  } aggregationPoolConfig;
+
+  /*
+   * One signature held by an AggregationPool
+   */
+  typedef struct poolEntry {
+    PubKey pubkey;
+    std::string msg;
+    Sig sig;
+  } poolEntry;
+
+  /*
+   * Result of one flush
+   * Only agg_sig is guaranteed valid for the included signers. On the optimistic path the
+   * entries are never checked one by one, so invalid signatures that cancel in the sum
+   * (sig_1 + d, sig_2 - d) are included. Verify an entry itself before relaying it alone
+   */
+  typedef struct poolFlush {
+    std::vector<poolEntry> included;  // signatures in the aggregate
+    std::vector<poolEntry> rejected;  // invalid signatures found by the fallback
+    Ec1 agg_sig;                      // sum of the included signatures, valid for their messages and pubkeys
+    bool optimistic;                  // true if the first aggregate check passed
+  } poolFlush;
+
+  /*
+   * Counters of an AggregationPool since it was created
+   */
+  typedef struct aggregationPoolStats {
+    uint64_t flushes;
+    uint64_t optimistic_successes;  // flushes where the single aggregate check passed
+    uint64_t fallbacks;             // flushes that had to bisect
+    uint64_t duplicates;            // signatures dropped because they were already pending
+    uint64_t rejected;              // invalid signatures found by the fallback
+    double optimistic_rate;         // optimistic_successes / flushes
+  } aggregationPoolStats;
+
+  class AggregationPool {
+    public:
+
+    typedef std::chrono::steady_clock clock;
+
+    /*
+     * Constructor
+     * @param {Bls&} bls, used for every verification, must outlive the pool
+     * @param {aggregationPoolConfig&} config, flush limits
+     * @param {function<void(const poolFlush&)>} on_flush, called with the result of every flush that had signatures
+     */
+    AggregationPool(Bls &bls, const aggregationPoolConfig &config, std::function<void(const poolFlush&)> on_flush);
+
+    /*
+     * Function: add, queue a signature, flushing first if the oldest pending signature is too old
+     * and afterwards if the pool reached max_size. Not thread safe
+     * @param {PubKey&} pubkey
+     * @param {char*|uint8_t*} msg, copied, binary messages pass their length
+     * @param {Sig&} sig
+     * @return {bool} false if the same triple was already pending and the signature was dropped
+     */
+    bool add(const PubKey &pubkey, const char* msg, const Sig &sig);
+    bool add(const PubKey &pubkey, const uint8_t *msg, size_t len, const Sig &sig);
+
+    /*
+     * Function: poll, flush if the oldest pending signature exceeded max_age_us
+     * Call periodically so a quiet pool still flushes on time
+     * @return {bool} true if a flush happened
+     */
+    bool poll();
+
+    // verify and hand out every pending signature now
+    void flush();
+
+    // number of pending signatures
+    size_t size() const;
+
+    aggregationPoolStats stats() const;
+
+    private:
+
+    Bls &bls;
+    aggregationPoolConfig config;
+    std::function<void(const poolFlush&)> on_flush;
+
+    std::vector<poolEntry> pending;
+    std::unordered_set<std::string> pending_keys;  // Bls::tripleKey of every pending signature
+    clock::time_point oldest;
+
+    aggregationPoolStats counters;
+  };
+}
+
+#endif
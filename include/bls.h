@@ -2,15 +2,27 @@
  * Dependencies: https://github.com/herumi/ate-pairing
  */
 
+#ifndef BLS_HEADER
+#define BLS_HEADER
+
 #include <iostream>
 #include <cmath>
 #include <typeinfo>
 #include "bn.h"
 #include "sha256.h"
+#include "thread_pool.h"
+#include "bounded_queue.h"
+#include "verify_cache.h"
 #include <vector>
 #include <string>
 #include <map>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
 #include <openssl/rand.h>
+#include <algorithm>
+#include <cstdlib>
 #include "../src/test_point.hpp"
 
 
@@ -35,7 +47,32 @@ namespace bls {
     Ec2 ec2;
 
     Ec2 toEc2();
-    std::string toString();
+    std::string toString() const;
+  };
+
+
+  /*
+   * PubKey with the line coefficients of its G2 Miller loop precomputed
+   * Build once for keys that are verified against repeatedly
+   */
+  class PreparedPubKey {
+    public:
+    explicit PreparedPubKey(const PubKey &pubkey);
+
+    // pubkey point (in Ec2 - defined in ate-pairing lib)
+    Ec2 ec2;
+
+    // Miller loop line coefficients for ec2
+    std::vector<Fp6> coeff;
+
+    // SHA256 state with the pubkey prefix of hashMsgWithPubkey already absorbed, cloned per message
+    SHA256 hash_prefix;
+
+    /*
+     * Function: memoryFootprint
+     * @return {size_t} bytes held by this key, including the line coefficients
+     */
+    size_t memoryFootprint() const;
   };
 
 
@@ -57,6 +94,108 @@ namespace bls {
     Ec1 toEc1();
   };
 
+  /*
+   * Container for managing the format and serialization of a partial pairing product,
+   * the Miller loop product of a slice of an aggregate before the final exponentiation
+   * Serialized as the 12 Fp coefficients of the Fp12 value, each 32 bytes big endian
+   */
+  class PartialProduct {
+    public:
+    PartialProduct(Fp12 fp12);
+    PartialProduct(const std::string &serializedPartial);
+
+    static const size_t SERIALIZED_SIZE = 12 * 32;
+
+    // Miller loop product (in Fp12 - defined in ate-pairing lib)
+    Fp12 fp12;
+
+    std::string serialize() const;
+
+    private:
+    // pointers to the Fp coefficients of f in serialization order
+    static void coefficients(Fp12 &f, Fp *coeffs[12]);
+  };
+
+
+  /*
+   * Structure to hold an independent (pubkey, message, signature) triple
+   */
+  typedef struct sigTriple {
+    PubKey pubkey;
+    const char* msg;
+    Sig sig;
+  } sigTriple;
+
+  /*
+   * Binary message given by pointer and length, may contain NUL bytes. The bytes are not copied
+   */
+  typedef struct msgRef {
+    const uint8_t *data;
+    size_t len;
+  } msgRef;
+
+  /*
+   * Messages stored back to back in one buffer, message i is data[offsets[i], offsets[i+1])
+   * Lets the aggregate and batch paths read a network buffer in place
+   */
+  typedef struct msgArena {
+    const uint8_t *data;
+    const size_t *offsets;  // count + 1 non decreasing offsets into data
+    size_t count;           // number of messages
+  } msgArena;
+
+  /*
+   * Owning message arena for callers that copy messages anyway, e.g. to queue them
+   * Messages are appended back to back, arena() is valid until the next add or clear
+   */
+  class MessageBuffer {
+    public:
+    MessageBuffer();
+
+    void add(const uint8_t *msg, size_t len);
+    void add(const std::string &msg);
+
+    // message i without copying it
+    msgRef operator[](size_t i) const;
+
+    msgArena arena() const;
+    size_t size() const;
+    void clear();
+
+    private:
+    std::string data;
+    std::vector<size_t> offsets;  // size() + 1 entries
+  };
+
+  /*
+   * Stage sizes for pipelined aggregate verification
+   */
+  typedef struct pipelineConfig {
+    size_t hash_threads;    // threads hashing messages onto the curve
+    size_t miller_threads;  // threads running Miller loops on the hashed points
+    size_t queue_capacity;  // hashed points buffered between the two stages
+  } pipelineConfig;
+
+  /*
+   * Counters from one pipelined aggregate verification
+   */
+  typedef struct pipelineStats {
+    size_t queue_capacity;
+    size_t max_queue_depth;  // deepest the queue got
+    double avg_queue_depth;  // mean depth right after each push
+    uint64_t hash_stalls;    // pushes that waited on a full queue (Miller stage too slow)
+    uint64_t miller_stalls;  // pops that waited on an empty queue (hash stage too slow)
+  } pipelineStats;
+
+  /*
+   * Counters from one streaming aggregate verification
+   */
+  typedef struct streamStats {
+    uint64_t records;        // (pubkey, message) records read
+    double seconds;          // wall time of the verification
+    double records_per_sec;  // throughput
+  } streamStats;
+
   /*
    * Structure to threshold secret point
    */
@@ -82,6 +221,69 @@ namespace bls {
     Fp y;
   } shamirPoint;
 
+  /*
+   * Maps from message digests onto G1, selected with Bls::setHashSuite
+   * Signatures only verify under the suite they were made with
+   */
+  enum HashSuite {
+    HASH_TRY_AND_INCREMENT,  // the original map, cost varies with the number of tries
+    HASH_SVDW                // Shallue-van de Woestijne map (Fouque-Tibouchi variant for BN curves), fixed cost
+  };
+
+  /*
+   * Mixed collection of single, aggregate and combined threshold signatures, verified together
+   * by Bls::verifySignatureSet with one final exponentiation. Items are numbered in the order
+   * they were added and messages are copied, so the arguments need not outlive the set
+   */
+  class SignatureSet {
+    public:
+
+    enum itemKind {
+      SINGLE,
+      AGGREGATE,
+      THRESHOLD
+    };
+
+    /*
+     * Function: addSingle
+     * @return {size_t} index of the new item
+     */
+    size_t addSingle(const PubKey &pubkey, const char* msg, const Sig &sig);
+    size_t addSingle(const PubKey &pubkey, const uint8_t *msg, size_t len, const Sig &sig);
+
+    /*
+     * Function: addAggregate, add an aggregate signature over one message per pubkey
+     * Throws std::invalid_argument if the message and pubkey counts differ
+     * @return {size_t} index of the new item
+     */
+    size_t addAggregate(const std::vector<const char*> &messages, const std::vector<PubKey> &pubkeys, const Sig &sig);
+    size_t addAggregate(const msgArena &messages, const std::vector<PubKey> &pubkeys, const Sig &sig);
+
+    /*
+     * Function: addThreshold, add a threshold signature combined with Bls::combineThresholdSigs
+     * @param {PubKey&} group_pubkey, public key of the shared secret
+     * @return {size_t} index of the new item
+     */
+    size_t addThreshold(const PubKey &group_pubkey, const char* msg, const Sig &sig);
+    size_t addThreshold(const PubKey &group_pubkey, const uint8_t *msg, size_t len, const Sig &sig);
+
+    itemKind kind(size_t item) const;
+    size_t size() const;
+    void clear();
+
+    private:
+    friend class Bls;
+
+    typedef struct setItem {
+      itemKind kind;
+      std::vector<std::string> messages;
+      std::vector<PubKey> pubkeys;  // pubkeys[j] signed messages[j]
+      Ec1 sig;
+    } setItem;
+
+    std::vector<setItem> items;
+  };
+
 
   class Bls {
 
@@ -90,12 +292,47 @@ namespace bls {
     Ec1 g1;
     Ec2 g2;
     bn::CurveParam cp;
+
+    // Miller loop line coefficients for g2, precomputed in the constructor
+    std::vector<Fp6> g2_coeff;
     
     /*
      * Constructor for the Bls class
      */
     Bls();
 
+    /*
+     * Function: setNumThreads, set the number of worker threads used for aggregate verification
+     * @param {size_t} num_threads, 1 (the default) keeps all work on the calling thread
+     */
+    void setNumThreads(size_t num_threads);
+    size_t getNumThreads() const;
+
+    /*
+     * Function: setVerifyCache, remember successful verifications to skip repeated work
+     * verifySig, including the PreparedPubKey overloads, and verifySigLowLatency return immediately
+     * for a (pubkey, message, signature) triple that already verified. Pass NULL to stop caching.
+     * The cache may be shared between Bls instances
+     * @param {shared_ptr<VerifyCache>} cache
+     */
+    void setVerifyCache(std::shared_ptr<VerifyCache> cache);
+    std::shared_ptr<VerifyCache> getVerifyCache() const;
+
+    /*
+     * Function: setLowLatency, start or stop the dedicated workers used by verifySigLowLatency
+     * Safe to call while other threads verify, verifications already running keep the old workers
+     * @param {bool} enabled
+     */
+    void setLowLatency(bool enabled);
+
+    /*
+     * Function: setHashSuite, select the map used by hashMsgWithPubkey
+     * Safe to call while other threads verify, verifications already running may use either suite
+     * @param {HashSuite} suite, HASH_TRY_AND_INCREMENT (the default) or HASH_SVDW
+     */
+    void setHashSuite(HashSuite suite);
+    HashSuite getHashSuite() const;
+
     /*
      * Function genPubKey: generate a public key from a random seed
      * @param {const string&} rand_seed, string representation of 256 bit int
@@ -126,12 +363,34 @@ namespace bls {
      * @param {const Pubkey} pubkey  point in G2 representing the pubkey
      * @param {const char*} msg  the message that was signed
      * @param {const Sig} sig  the point in G1 representing the signature
+     * @param {bool} delay_exp  run both Miller loops before a single shared final exponentiation,
+     *   checking e(g, sig) * e(pubkey, -H(m)) == 1 instead of comparing two full pairings
      */
-    bool verifySig(PubKey const &pubkey, const char* msg, const Sig &sig);
-    bool verifySig(PubKey const &pubkey, const char* msg, const Ec1 sigEc1);
+    bool verifySig(PubKey const &pubkey, const char* msg, const Sig &sig, bool delay_exp=true);
+    bool verifySig(PubKey const &pubkey, const char* msg, const Ec1 sigEc1, bool delay_exp=true);
+
+    // binary messages, the whole buffer is signed including any NUL bytes
+    bool verifySig(PubKey const &pubkey, const uint8_t *msg, size_t len, const Sig &sig, bool delay_exp=true);
+    bool verifySig(PubKey const &pubkey, const std::string &msg, const Sig &sig, bool delay_exp=true);
+
+    // verify against a key with precomputed line coefficients (single final exponentiation)
+    bool verifySig(PreparedPubKey const &pubkey, const char* msg, const Sig &sig);
+    bool verifySig(PreparedPubKey const &pubkey, const uint8_t *msg, size_t len, const Sig &sig);
+    bool verifySig(PreparedPubKey const &pubkey, const std::string &msg, const Sig &sig);
+
+    /*
+     * Function: verifySigLowLatency, verify a signature for latency critical callers
+     * The e(g, sig) Miller loop and the line coefficients of pubkey are computed on dedicated
+     * workers (see setLowLatency) while the calling thread hashes the message, which then only
+     * evaluates the precomputed lines at -H(m). A single shared final exponentiation finishes the
+     * check. Without the workers this is the serial verifySig
+     */
+    bool verifySigLowLatency(PubKey const &pubkey, const char* msg, const Sig &sig);
+    bool verifySigLowLatency(PubKey const &pubkey, const uint8_t *msg, size_t len, const Sig &sig);
 
     // try both signs of signature
     bool verifySigSignAgnostic(PubKey const &pubkey, const char* msg, Sig const &sig);
+    bool verifySigSignAgnostic(PubKey const &pubkey, const uint8_t *msg, size_t len, Sig const &sig);
 
 
     /* 
@@ -145,17 +404,193 @@ namespace bls {
     Sig signMsg(const char *msg, const mie::Vuint secret_key, const PubKey &pubkey);
     Sig signMsg(std::string& msg, const mie::Vuint secret_key, const PubKey &pubkey);
 
+    // binary message of len bytes, may contain NUL bytes. The std::string overload above signs msg.size() bytes too
+    Sig signMsg(const uint8_t *msg, size_t len, const mie::Vuint secret_key, const PubKey &pubkey);
+
 
     /* 
      * Function: verifyAggSig()
      * Verify aggregate signature for n pubkey, msg pairs
      * Each message/pubkey need not be be distinct:
      * Unrestricted Aggregate Signatures, Bellare, et. al (http://link.springer.com/chapter/10.1007%2F978-3-540-73420-8_37)
+     * Messages signed under the same pubkey share one Miller loop, e(pk, H_1) * e(pk, H_2) = e(pk, H_1 + H_2)
+     * With more than one thread (see setNumThreads) the pubkeys are split into one shard per worker,
+     * each hashing and Miller-looping its shard into a partial product
      * @param {vector<char*>*} Vector containing pubkeys used in aggregate signature
      * @param {vector<char*>*} Vector containing messages used in aggregate signature
      * @param {Ec1 sig} Point in G1 representing aggregate signature
+     * @param {bool} delay_exp, apply a single final exponentiation to the product of Miller loops
+     * @param {bool} group_keys, sum the hashed messages of each distinct pubkey before its Miller loop
+     */
+    bool verifyAggSig(const std::vector<const char*> &messages, const std::vector<PubKey> &pubkeys, const Sig &sig,
+      bool delay_exp=true, bool group_keys=true);
+
+    // verify against keys with precomputed line coefficients, delay_exp and group_keys as above
+    bool verifyAggSig(const std::vector<const char*> &messages, const std::vector<const PreparedPubKey*> &pubkeys, const Sig &sig,
+      bool delay_exp=true, bool group_keys=true);
+
+    /*
+     * Function: verifyAggSig()
+     * Same checks as above for binary messages read in place from an arena, nothing is copied
+     * Unlike the char* overloads, which return false, a message count that differs from the
+     * pubkey count throws std::invalid_argument, as do decreasing arena offsets
+     * @param {msgArena&} messages, one message per pubkey
+     * @param {vector<PubKey>&|vector<const PreparedPubKey*>&} pubkeys
+     * @param {Sig&} sig, aggregate signature
+     * @return {bool} true iff the aggregate signature is valid
+     */
+    bool verifyAggSig(const msgArena &messages, const std::vector<PubKey> &pubkeys, const Sig &sig,
+      bool delay_exp=true, bool group_keys=true);
+    bool verifyAggSig(const msgArena &messages, const std::vector<const PreparedPubKey*> &pubkeys, const Sig &sig,
+      bool delay_exp=true, bool group_keys=true);
+
+    /*
+     * Function: verifyAggSig()
+     * Pipelined aggregate verification: hash threads map each pubkey's messages onto the curve and
+     * push the points into a bounded queue, while Miller loop threads consume them as they arrive,
+     * hiding hashing latency behind pairing work. Stages run on their own threads, not the worker pool
+     * @param {pipelineConfig&} config, threads per stage and queue capacity
+     * @param {pipelineStats*} stats, if not NULL populated with queue depth and stall counters
+     */
+    bool verifyAggSig(const std::vector<const char*> &messages, const std::vector<PubKey> &pubkeys, const Sig &sig,
+      const pipelineConfig &config, pipelineStats *stats=NULL);
+
+    // pipelined verification of arena messages, throws std::invalid_argument on a count mismatch
+    bool verifyAggSig(const msgArena &messages, const std::vector<PubKey> &pubkeys, const Sig &sig,
+      const pipelineConfig &config, pipelineStats *stats=NULL);
+
+    /*
+     * Function: aggPartialProduct()
+     * Compute the part of an aggregate verification for the pairs in [begin, end), so a large
+     * aggregate can be split across processes or machines. Combine with verifyAggPartials
+     * Throws std::invalid_argument if the slice is out of range or the message and pubkey counts differ
+     * @param {vector<char*>&|msgArena&} messages, messages of the aggregate signature
+     * @param {vector<PubKey>&} pubkeys, pubkeys of the aggregate signature
+     * @param {size_t} begin, first pair of the slice
+     * @param {size_t} end, one past the last pair of the slice
+     * @return {PartialProduct} prod e(pubkey_i, H(m_i)) over the slice before the final exponentiation
+     */
+    PartialProduct aggPartialProduct(const std::vector<const char*> &messages, const std::vector<PubKey> &pubkeys,
+      size_t begin, size_t end);
+    PartialProduct aggPartialProduct(const msgArena &messages, const std::vector<PubKey> &pubkeys,
+      size_t begin, size_t end);
+
+    /*
+     * Function: verifyAggPartials()
+     * Multiply the partial products of all slices, apply the final exponentiation once and compare against e(g, sig)
+     * @param {vector<PartialProduct>&} partials, one per slice, together covering every pair exactly once
+     * @param {Sig&} sig, aggregate signature
+     * @return {bool} true iff the aggregate signature is valid
+     */
+    bool verifyAggPartials(const std::vector<PartialProduct> &partials, const Sig &sig);
+
+    /*
+     * Function: writeAggRecord()
+     * Append one (pubkey, message) record of an aggregate to a stream read by verifyAggSigStream
+     * Record format: 4 byte little endian length, PubKey::toString(), 4 byte little endian length, message
+     * @param {ostream&} out, stream to write to
+     * @param {PubKey&} pubkey
+     * @param {const char*} msg
+     */
+    void writeAggRecord(std::ostream &out, const PubKey &pubkey, const char* msg);
+    void writeAggRecord(std::ostream &out, const PubKey &pubkey, const uint8_t *msg, size_t len);
+
+    /*
+     * Function: verifyAggSigStream()
+     * Verify an aggregate signature over (pubkey, message) records read from a stream in chunks
+     * Each chunk is folded into the running Miller loop product and then dropped, so memory use
+     * depends on chunk_size only, not on the number of records
+     * Throws std::invalid_argument on a truncated or malformed record
+     * @param {istream&} records, records written by writeAggRecord (e.g. a std::ifstream)
+     * @param {Sig&} sig, aggregate signature
+     * @param {size_t} chunk_size, records per chunk
+     * @param {streamStats*} stats, if not NULL populated with the record count and throughput
+     * @return {bool} true iff the aggregate signature is valid
+     */
+    bool verifyAggSigStream(std::istream &records, const Sig &sig, size_t chunk_size=1024, streamStats *stats=NULL);
+
+    // same as above, reading records from a memory region such as an mmap of the record file
+    bool verifyAggSigStream(const char *data, size_t len, const Sig &sig, size_t chunk_size=1024, streamStats *stats=NULL);
+
+    /*
+     * Function: verifyBatch()
+     * Verify n independent signatures at once. Each triple is weighted by a random
+     * 64 bit scalar r_i and the batch is accepted iff
+     * prod e(pubkey_i, r_i * H(m_i)) * e(g, -sum r_i * sig_i) == 1
+     * which costs n+1 Miller loops and a single final exponentiation
+     * @param {vector<sigTriple>&} batch, triples to verify
+     * @return {bool} true iff every triple is valid (except with probability ~2^-64)
+     */
+    bool verifyBatch(const std::vector<sigTriple> &batch);
+
+    /*
+     * Function: verifyBatch()
+     * Same check as above, but when the batch fails it is bisected to find the invalid triples.
+     * Bisection reuses the per-triple Miller loops of the first check, so each extra check only
+     * costs one Miller loop for the signature side and a final exponentiation, and the number
+     * of extra checks grows with the number of bad triples rather than the batch size
+     * @param {vector<sigTriple>&} batch, triples to verify
+     * @param {vector<size_t>&} bad_indices, populated with the indices of the invalid triples
+     * @return {bool} true iff every triple is valid
+     */
+    bool verifyBatch(const std::vector<sigTriple> &batch, std::vector<size_t> &bad_indices);
+
+    /*
+     * Function: verifyBatch()
+     * Batch check of binary messages read in place from an arena, message i is signed by sigs[i] under pubkeys[i]
+     * Throws std::invalid_argument if the sizes differ or the arena offsets decrease
+     * @param {msgArena&} messages
+     * @param {vector<PubKey>&} pubkeys
+     * @param {vector<Sig>&} sigs
+     * @return {bool} true iff every signature is valid
+     */
+    bool verifyBatch(const msgArena &messages, const std::vector<PubKey> &pubkeys, const std::vector<Sig> &sigs);
+    bool verifyBatch(const msgArena &messages, const std::vector<PubKey> &pubkeys, const std::vector<Sig> &sigs,
+      std::vector<size_t> &bad_indices);
+
+    /*
+     * Function: verifySameSigner()
+     * Batch verify many signatures by one signer: with random 64 bit r_i the checks collapse to
+     * e(g, sum r_i * sig_i) == e(pubkey, sum r_i * H(m_i)), two pairings and two multi-scalar
+     * multiplications for the whole window
+     * @param {PubKey&|PreparedPubKey&} pubkey, the signer, a PreparedPubKey also skips its line computation
+     * @param {vector<char*>&} messages, messages[i] is signed by sigs[i]
+     * @param {vector<Sig>&} sigs
+     * @return {bool} true iff every signature is valid (with overwhelming probability)
+     */
+    bool verifySameSigner(const PubKey &pubkey, const std::vector<const char*> &messages, const std::vector<Sig> &sigs);
+    bool verifySameSigner(const PreparedPubKey &pubkey, const std::vector<const char*> &messages, const std::vector<Sig> &sigs);
+
+    /*
+     * Function: verifySameSigner()
+     * As above, on failure bisects the window to find the invalid signatures
+     * @param {vector<size_t>&} bad_indices, populated with the indices of invalid signatures in increasing order
+     */
+    bool verifySameSigner(const PubKey &pubkey, const std::vector<const char*> &messages, const std::vector<Sig> &sigs,
+      std::vector<size_t> &bad_indices);
+
+    // same checks for arena messages, throws std::invalid_argument unless there is one signature per message
+    bool verifySameSigner(const PubKey &pubkey, const msgArena &messages, const std::vector<Sig> &sigs);
+    bool verifySameSigner(const PreparedPubKey &pubkey, const msgArena &messages, const std::vector<Sig> &sigs);
+    bool verifySameSigner(const PubKey &pubkey, const msgArena &messages, const std::vector<Sig> &sigs,
+      std::vector<size_t> &bad_indices);
+
+    /*
+     * Function: verifySignatureSet()
+     * Verify every item of a SignatureSet with one random linear combination: each item's signature
+     * and hashed messages are weighted by a random 64 bit scalar, messages under the same pubkey share
+     * a Miller loop across items, and the whole set pays a single final exponentiation
+     * @param {SignatureSet&} set
+     * @return {bool} true iff every item is valid (with overwhelming probability)
+     */
+    bool verifySignatureSet(const SignatureSet &set);
+
+    /*
+     * Function: verifySignatureSet()
+     * As above, on failure bisects the set to find the invalid items
+     * @param {vector<size_t>&} bad_items, populated with the indices of invalid items in increasing order
      */
-    bool verifyAggSig(const std::vector<const char*> &messages, const std::vector<PubKey> &pubkeys, const Sig &sig, bool delay_exp=true);
+    bool verifySignatureSet(const SignatureSet &set, std::vector<size_t> &bad_items);
 
     /* Function: verify_threshold_sig
     * @param {char*} msg
@@ -171,6 +606,35 @@ namespace bls {
      */
     Ec1 hashMsgWithPubkey(const char *msg, const Ec2 &pubkey);
 
+    /* Function: hashMsgWithPubkey
+     * Same point as hashing with pubkey.ec2, but only the message is hashed: the pubkey prefix
+     * was absorbed into a SHA256 state when the key was prepared
+     * @param {char*} msg
+     * @param {PreparedPubKey&} pubkey
+     * @return {Ec1} point in G_1
+     */
+    Ec1 hashMsgWithPubkey(const char *msg, const PreparedPubKey &pubkey);
+
+    // binary message of len bytes, hashMsgWithPubkey(msg, pk) == hashMsgWithPubkey((uint8_t*)msg, strlen(msg), pk)
+    Ec1 hashMsgWithPubkey(const uint8_t *msg, size_t len, const Ec2 &pubkey);
+    Ec1 hashMsgWithPubkey(const uint8_t *msg, size_t len, const PreparedPubKey &pubkey);
+
+    /*
+     * Function: pubkeyHashPrefix, SHA256 state after absorbing the pubkey prefix of hashMsgWithPubkey
+     * @param {Ec2&} pubkey
+     * @return {SHA256} state to copy for each message hashed under pubkey
+     */
+    static SHA256 pubkeyHashPrefix(const Ec2 &pubkey);
+
+    /*
+     * Function: toMsgRefs, view messages as msgRefs without copying them
+     * Throws std::invalid_argument if the arena offsets decrease
+     * @param {vector<char*>&|msgArena&} messages
+     * @return {vector<msgRef>} one reference per message
+     */
+    static std::vector<msgRef> toMsgRefs(const std::vector<const char*> &messages);
+    static std::vector<msgRef> toMsgRefs(const msgArena &messages);
+
     /*
      * Function: genThreshKeys, centralized generation of collection of threshold keyshares
      * @param {char*} secret, secret key to split amongst shares
@@ -182,6 +646,21 @@ namespace bls {
     // TODO: maybe have this explicitly return the new vector
     void genThreshKeys(const char* secret, size_t t, size_t n, std::vector<thresholdPoint>& pair_vec);
 
+    /*
+     * Function: verifyThresholdShares, check a set of signature shares on the same message at once
+     * Checks e(g2, sum r_i * s_i) == e(sum r_i * pk_i, H(pk||m)) with random 64 bit r_i, which costs
+     * two pairings and two multi-scalar multiplications however many shares there are
+     * @param {vector<thresholdSigPoint>&} shares, signature shares from signMsg with the group pubkey
+     * @param {vector<PubKey>&} share_pubkeys, share_pubkeys[i] is the public key of the key share behind shares[i]
+     * @param {char*} msg, message signed by every share
+     * @param {PubKey&} pubkey, group public key the shares were hashed with
+     * @return {bool} true iff every share is valid (with overwhelming probability)
+     */
+    bool verifyThresholdShares(const std::vector<thresholdSigPoint>& shares,
+      const std::vector<PubKey>& share_pubkeys, const char* msg, const PubKey& pubkey);
+    bool verifyThresholdShares(const std::vector<thresholdSigPoint>& shares,
+      const std::vector<PubKey>& share_pubkeys, const uint8_t *msg, size_t len, const PubKey& pubkey);
+
     /*
      * Function: combineThresholdSigs, calculate single signature from collection of shares
      * @param {vector<thresholdSigPoint>&} vector of shares, each containing signature and x-coord
@@ -192,6 +671,88 @@ namespace bls {
 
     Ec1 mapHashOntoCurve(const char* hashed_message);
 
+    /*
+     * Function: mapHashOntoCurve
+     * Byte oriented try-and-increment map, gives the same point as the hex string version for the same
+     * digest without formatting or parsing it: the digest is shifted and reduced on the stack and every
+     * try adds a precomputed power of 2
+     * @param {uint8_t*} digest, SHA256::DIGEST_SIZE bytes
+     * @return {Ec1} point in G_1
+     */
+    Ec1 mapHashOntoCurve(const uint8_t *digest);
+
+    /*
+     * Function: mapHashOntoCurveSvdW
+     * Fixed cost map of a message digest onto G1 (HASH_SVDW suite). Two field elements t1, t2 are
+     * derived from 512 bits of SHA256 output each, reduced mod p, and the result is f(t1) + f(t2)
+     * for the Shallue-van de Woestijne map f. Every call runs the same field operations
+     * @param {unsigned char*} digest, SHA256::DIGEST_SIZE bytes
+     * @return {Ec1} point in G_1
+     */
+    Ec1 mapHashOntoCurveSvdW(const unsigned char *digest);
+
+    /*
+     * Function: tripleKey, SHA256 digest identifying a (pubkey, message, signature) triple
+     * Hashes the hash suite, the big endian coordinates of the normalized points, the message length
+     * and the message, so keys have a fixed size whatever the message length and hold no in memory
+     * field representation. Used as the verification cache key and for deduplication
+     * The current hash suite is part of the key, since a triple may only be valid under one of them
+     * @param {Ec2&} pubkey
+     * @param {const char*} msg
+     * @param {Ec1&} sig
+     * @return {string} SHA256::DIGEST_SIZE byte key, equal for equal triples
+     */
+    std::string tripleKey(const Ec2 &pubkey, const char* msg, const Ec1 &sig);
+    std::string tripleKey(const Ec2 &pubkey, const uint8_t *msg, size_t len, const Ec1 &sig);
+
+    /*
+     * Function: multiMillerLoop, prod e(g2_points[i], g1_points[i]) without the final exponentiation
+     * Products of several calls can be multiplied together before a single final_exp()
+     * Pairs with a point at infinity contribute 1. Pairs on the generator g2 use its precomputed lines
+     * @param {Ec1*|vector<Ec1>&} g1_points
+     * @param {Ec2*|vector<Ec2>&} g2_points, g2_points[i] is paired with g1_points[i]
+     * @param {size_t} n, number of pairs (pointer overloads)
+     * @param {vector<Fp6>**} g2_lines, optional, g2_lines[i] if not NULL holds precomputed lines
+     *   of g2_points[i] (see bn::precomputeG2 and PreparedPubKey)
+     * @param {ThreadPool*} workers, optional, Miller loops are sharded over the pool
+     * @return {Fp12} product of the Miller loops
+     */
+    Fp12 multiMillerLoop(const Ec1 *g1_points, const Ec2 *g2_points, size_t n,
+      const std::vector<Fp6>* const *g2_lines=NULL, ThreadPool *workers=NULL);
+    Fp12 multiMillerLoop(const std::vector<Ec1> &g1_points, const std::vector<Ec2> &g2_points,
+      const std::vector<const std::vector<Fp6>*> *g2_lines=NULL, ThreadPool *workers=NULL);
+
+    /*
+     * Function: multiPairing, prod e(g2_points[i], g1_points[i]) with one shared final exponentiation
+     * Arguments as for multiMillerLoop
+     * @return {Fp12} product of the pairings
+     */
+    Fp12 multiPairing(const Ec1 *g1_points, const Ec2 *g2_points, size_t n,
+      const std::vector<Fp6>* const *g2_lines=NULL, ThreadPool *workers=NULL);
+    Fp12 multiPairing(const std::vector<Ec1> &g1_points, const std::vector<Ec2> &g2_points,
+      const std::vector<const std::vector<Fp6>*> *g2_lines=NULL, ThreadPool *workers=NULL);
+
+    /*
+     * Function: multiPairingIsOne, check prod e(g2_points[i], g1_points[i]) == 1
+     * Arguments as for multiMillerLoop
+     * @return {bool}
+     */
+    bool multiPairingIsOne(const Ec1 *g1_points, const Ec2 *g2_points, size_t n,
+      const std::vector<Fp6>* const *g2_lines=NULL, ThreadPool *workers=NULL);
+    bool multiPairingIsOne(const std::vector<Ec1> &g1_points, const std::vector<Ec2> &g2_points,
+      const std::vector<const std::vector<Fp6>*> *g2_lines=NULL, ThreadPool *workers=NULL);
+
+    /*
+     * Function: mulVarTime, variable time scalar multiplication using a width-5 NAF
+     * The running time depends on the scalar, so only use it for public scalars (batch weights,
+     * Lagrange coefficients). Secret keys in signMsg and genPubKey keep using operator*
+     * @param {Ec1|Ec2} point
+     * @param {mie::Vuint} scalar, public scalar
+     * @return {Ec1|Ec2} scalar * point
+     */
+    Ec1 mulVarTime(const Ec1 &point, const mie::Vuint &scalar);
+    Ec2 mulVarTime(const Ec2 &point, const mie::Vuint &scalar);
+
     private:
 
     /* Function: nbits
@@ -223,6 +784,66 @@ namespace bls {
      * @return {Ec1} point in G_1
      */
 
+    /*
+     * Function: hashMsgWithPrefix, finish hashMsgWithPubkey from a pubkeyHashPrefix state
+     * @param {SHA256&} prefix, copied, so it can be reused for the next message
+     * @param {char*} msg
+     * @return {Ec1} point in G_1
+     */
+    Ec1 hashMsgWithPrefix(const SHA256 &prefix, const char *msg);
+    Ec1 hashMsgWithPrefix(const SHA256 &prefix, const uint8_t *msg, size_t len);
+
+    /*
+     * Function: hashMsgs, hashMsgWithPrefix for many messages, the SHA256 work runs on
+     * several messages at once with SHA256::hashMany
+     * @param {vector<const SHA256*>&} prefixes, pubkeyHashPrefix state of each message
+     * @param {vector<msgRef>&} messages
+     * @param {vector<Ec1>&} points, populated with the point of each message
+     */
+    void hashMsgs(const std::vector<const SHA256*> &prefixes, const std::vector<msgRef> &messages, std::vector<Ec1> &points);
+
+    // map a SHA256 digest onto G1 with the current hash suite
+    Ec1 mapDigest(const unsigned char *digest);
+
+    /*
+     * Function: arenaRefs, toMsgRefs of an arena that must hold count messages
+     * Throws std::invalid_argument if it holds a different number or its offsets decrease
+     */
+    static std::vector<msgRef> arenaRefs(const msgArena &messages, size_t count);
+
+    /*
+     * Function: verifyAggRefs, shared implementation of the verifyAggSig overloads for each kind of key
+     */
+    bool verifyAggRefs(const std::vector<msgRef> &messages, const std::vector<PubKey> &pubkeys, const Sig &sig,
+      bool delay_exp, bool group_keys);
+    bool verifyAggRefs(const std::vector<msgRef> &messages, const std::vector<const PreparedPubKey*> &pubkeys, const Sig &sig,
+      bool delay_exp, bool group_keys);
+    bool verifyAggRefs(const std::vector<msgRef> &messages, const std::vector<PubKey> &pubkeys, const Sig &sig,
+      const pipelineConfig &config, pipelineStats *stats);
+
+    /*
+     * Function: aggRefsProduct, shared implementation of aggPartialProduct
+     * @return {Fp12} prod e(pubkey_i, H(m_i)) over [begin, end) before the final exponentiation
+     */
+    Fp12 aggRefsProduct(const std::vector<msgRef> &messages, const std::vector<PubKey> &pubkeys, size_t begin, size_t end);
+
+    /*
+     * Function: svdwMap, Shallue-van de Woestijne map f: Fp -> E(Fp) for y^2 = x^3 + b
+     * Tries all three candidate x coordinates, so the cost does not depend on t
+     * The exceptional inputs t = 0 and t^2 = -(1 + b) are mapped like t = 1
+     * @param {Fp&} t
+     * @return {Ec1} point with x among the candidates and y of the same parity as t
+     */
+    Ec1 svdwMap(const Fp &t);
+
+    /*
+     * Function: bytesToFp, big endian bytes reduced mod p
+     * @param {unsigned char*} bytes
+     * @param {size_t} len
+     * @return {Fp}
+     */
+    Fp bytesToFp(const unsigned char *bytes, size_t len);
+
     /*
      * Function: calcPolynomial, Calculate y value of given x value and set of polynomial coefficients
      * y = secret + r_0*x + r_1 * x^2 + r_2 * x^3 ... r_n * x^n
@@ -232,5 +853,237 @@ namespace bls {
      * @return y {mie::Vuint}, value of evaluation of polynomial at x
      */
     mie::Vuint calcPolynomial(std::vector<mie::Vuint>& r_vals, mie::Vuint secret, int x);
+
+    /*
+     * Function: parallelProduct, multiply range products over [0, n), one shard per worker thread
+     * @param {size_t} n, size of the range
+     * @param {function<Fp12(size_t, size_t)>&} range_product, product over [begin, end)
+     * @param {ThreadPool*} workers, pool to shard over, NULL runs the whole range on the calling thread
+     * @return {Fp12} product over [0, n)
+     */
+    Fp12 parallelProduct(size_t n, const std::function<Fp12(size_t, size_t)> &range_product, ThreadPool *workers);
+
+    /*
+     * Function: groupByPubKey, group message indices by distinct pubkey
+     * pubkeys are identified by their normalized coordinates
+     * @param {vector<const Ec2*>&} pubkeys, pubkey of each message
+     * @param {bool} group_keys, if false every message gets its own group
+     * @param {vector<vector<size_t>>&} groups, populated with the message indices of each distinct pubkey
+     * @return void
+     */
+    void groupByPubKey(const std::vector<const Ec2*> &pubkeys, bool group_keys, std::vector<std::vector<size_t> > &groups);
+
+    /*
+     * Function: pubKeyId, identifier of a pubkey built from its normalized coordinates
+     * @param {Ec2&} pubkey
+     * @return {string} identifier, equal for equal points
+     */
+    std::string pubKeyId(const Ec2 &pubkey);
+
+    /*
+     * Function: aggMillerProduct, product of the pairings e(pubkey_g, sum H(m_i)) over the groups in [begin, end)
+     * @param {vector<msgRef>&} messages, messages of the aggregate signature
+     * @param {vector<PubKey>&} pubkeys, pubkeys of the aggregate signature
+     * @param {vector<vector<size_t>>&} groups, message indices sharing a pubkey
+     * @param {size_t} begin, first group
+     * @param {size_t} end, one past the last group
+     * @param {bool} delay_exp, skip the final exponentiation of each pairing
+     * @return {Fp12} product of the pairings
+     */
+    Fp12 aggMillerProduct(const std::vector<msgRef> &messages, const std::vector<PubKey> &pubkeys,
+      const std::vector<std::vector<size_t> > &groups, size_t begin, size_t end, bool delay_exp);
+
+    /*
+     * Function: verifyAggRecords, shared implementation of verifyAggSigStream
+     * @param {function<size_t(char*, size_t)>&} read, copy up to n bytes into buf, returns the bytes copied
+     * @param {Sig&} sig, aggregate signature
+     * @param {size_t} chunk_size, records per chunk
+     * @param {streamStats*} stats, if not NULL populated with the record count and throughput
+     * @return {bool} true iff the aggregate signature is valid
+     */
+    bool verifyAggRecords(const std::function<size_t(char*, size_t)> &read, const Sig &sig, size_t chunk_size, streamStats *stats);
+
+    /*
+     * Function: parseRecordPubKey, PubKey of an aggregate record, which comes from an untrusted source
+     * Throws std::invalid_argument unless the field is four '_' separated decimal coordinates of a point on the curve
+     * @param {string&} field, PubKey::toString() of the signer
+     * @return {PubKey}
+     */
+    static PubKey parseRecordPubKey(const std::string &field);
+
+    /*
+     * Function: absorbFp, update a SHA256 state with the canonical 32 byte big endian encoding of x
+     */
+    static void absorbFp(SHA256 &ctx, const Fp &x);
+
+    /*
+     * Function: verifySigUncached, verifySig without the verification cache
+     */
+    bool verifySigUncached(PubKey const &pubkey, const uint8_t *msg, size_t len, const Ec1 sigEc1, bool delay_exp);
+
+    /*
+     * Function: genBatchScalars, generate nonzero random scalars for batch verification
+     * @param {size_t} n, number of scalars
+     * @param {vector<uint64_t>&} scalars, vector to be populated with the scalars
+     * @return void
+     */
+    void genBatchScalars(size_t n, std::vector<uint64_t>& scalars);
+
+    /*
+     * Function: checkBatch, shared implementation of verifyBatch
+     * @param {vector<msgRef>&} messages, message of each signature
+     * @param {vector<const PubKey*>&} pubkeys, signer of each signature
+     * @param {vector<Ec1>&} sig_points, signatures to verify
+     * @param {vector<size_t>*} bad_indices, if not NULL a failed batch is bisected into it
+     * @return {bool} true iff every signature is valid
+     */
+    bool checkBatch(const std::vector<msgRef> &messages, const std::vector<const PubKey*> &pubkeys,
+      const std::vector<Ec1> &sig_points, std::vector<size_t>* bad_indices);
+
+    // adapt the verifyBatch inputs to the overload above
+    bool checkBatch(const std::vector<sigTriple>& batch, std::vector<size_t>* bad_indices);
+    bool checkBatch(const msgArena &messages, const std::vector<PubKey> &pubkeys, const std::vector<Sig> &sigs,
+      std::vector<size_t>* bad_indices);
+
+    /*
+     * Function: checkSignatureSet, shared implementation of verifySignatureSet
+     * @param {vector<size_t>*} bad_items, if not NULL populated with the invalid items on failure
+     */
+    bool checkSignatureSet(const SignatureSet &set, std::vector<size_t> *bad_items);
+
+    /*
+     * Function: checkSameSigner, shared implementation of verifySameSigner
+     * @param {Ec2&} pubkey
+     * @param {vector<Fp6>*} lines, precomputed lines of pubkey or NULL
+     * @param {SHA256&} hash_prefix, pubkeyHashPrefix(pubkey), computed once for the window
+     * @param {vector<size_t>*} bad_indices, if not NULL populated with the invalid signatures on failure
+     */
+    bool checkSameSigner(const Ec2 &pubkey, const std::vector<Fp6> *lines, const SHA256 &hash_prefix,
+      const std::vector<msgRef> &messages, const std::vector<Sig> &sigs, std::vector<size_t> *bad_indices);
+
+    /*
+     * Function: checkBatchProduct, finish a batch check
+     * @param {Fp12&} miller_prod, product of Miller loops prod e(pk_i, r_i * H(m_i)) before final exponentiation
+     * @param {Ec1} sig_sum, sum r_i * sig_i of the weighted signatures
+     * @return {bool} true iff miller_prod * e(g, -sig_sum) == 1 after the final exponentiation
+     */
+    bool checkBatchProduct(const Fp12& miller_prod, Ec1 sig_sum);
+
+    /*
+     * Function: bisectBatch, find the invalid leaves below a node of a heap ordered batch tree
+     * @param {function<bool(size_t)>&} node_valid, runs the batch check over the leaves below a node
+     * @param {size_t} node, index of the node to search
+     * @param {size_t} leaves, number of leaves in the tree (power of 2)
+     * @param {size_t} n, number of leaves holding items
+     * @param {bool} known_bad, node is already known to fail so its own check is skipped
+     * @param {vector<size_t>&} bad_indices, populated with the indices of failing leaves
+     * @return void
+     */
+    void bisectBatch(const std::function<bool(size_t)> &node_valid, size_t node,
+      size_t leaves, size_t n, bool known_bad, std::vector<size_t>& bad_indices);
+
+    /*
+     * Function: scalarLimbs, split a scalar into 64 bit limbs
+     * @param {mie::Vuint} scalar
+     * @return {vector<uint64_t>} limbs, least significant first
+     */
+    std::vector<uint64_t> scalarLimbs(const mie::Vuint &scalar);
+
+    /*
+     * Function: wnafMul, variable time width-w NAF scalar multiplication for public scalars
+     * @param {Ec&} point, point in Ec1 or Ec2
+     * @param {vector<uint64_t>&} scalar, limbs of the scalar, least significant first
+     * @param {size_t} w, window width (2 to 8), uses 2^(w-2) precomputed odd multiples
+     * @return {Ec} scalar * point
+     */
+    template<class Ec>
+    Ec wnafMul(const Ec &point, const std::vector<uint64_t> &scalar, size_t w);
+
+    /*
+     * Function: multiScalarMul, calculate sum scalars[i] * points[i] with the bucket method
+     * @param {Ec*} points, points in Ec1 or Ec2
+     * @param {uint64_t*} scalars, one scalar per point
+     * @param {size_t} n, number of points
+     * @return {Ec} sum of the scaled points
+     */
+    template<class Ec>
+    Ec multiScalarMul(const Ec* points, const uint64_t* scalars, size_t n);
+
+    // worker pool for aggregate verification, NULL when running on a single thread
+    std::shared_ptr<ThreadPool> pool;
+
+    // dedicated workers for verifySigLowLatency, NULL when disabled, only accessed through std::atomic_load/store
+    std::shared_ptr<ThreadPool> latency_pool;
+
+    // successful verifications, NULL when caching is off
+    std::shared_ptr<VerifyCache> verify_cache;
+
+    // read by worker threads while setHashSuite may write it. std::atomic is not copyable,
+    // so a copy of the Bls object starts with the suite of the original
+    struct atomicHashSuite : std::atomic<HashSuite> {
+      atomicHashSuite(HashSuite suite=HASH_TRY_AND_INCREMENT) : std::atomic<HashSuite>(suite) {}
+      atomicHashSuite(const atomicHashSuite &other) : std::atomic<HashSuite>(other.load()) {}
+      atomicHashSuite& operator=(const atomicHashSuite &other) {
+        store(other.load());
+        return *this;
+      }
+    };
+    atomicHashSuite hash_suite;
+
+    // sqrt(-3) and the cube root of unity (-1 + sqrt(-3)) / 2, used by the SvdW map
+    Fp svdw_sqrt_neg3;
+    Fp svdw_c1;
+
+    // pow2_table[i] = 2^i, the increment of each try in the byte oriented mapHashOntoCurve
+    std::vector<Fp> pow2_table;
+  };
+
+
+  /*
+   * Incremental aggregate signature verifier
+   * Keeps the running product of Miller loops e(pubkey_i, H(m_i)) before the final exponentiation
+   * and the running aggregate signature, so signers can be added and removed as signatures arrive
+   * and check() only pays for the signature side Miller loop and one final exponentiation
+   */
+  class AggVerifier {
+    public:
+    AggVerifier(Bls &bls);
+
+    /*
+     * Function: add, add a signer to the aggregate
+     * @param {const PubKey&} pubkey
+     * @param {const char*|const uint8_t*} msg  the message that was signed, binary messages pass their length
+     * @param {const Sig&} sig  the signer's signature
+     */
+    void add(const PubKey &pubkey, const char* msg, const Sig &sig);
+    void add(const PubKey &pubkey, const uint8_t *msg, size_t len, const Sig &sig);
+
+    /*
+     * Function: remove, remove a previously added signer from the aggregate
+     * Multiplies in e(pubkey, -H(m)), which cancels the signer's Miller loop after the final exponentiation
+     * Removing a signer that was never added makes check() fail
+     */
+    void remove(const PubKey &pubkey, const char* msg, const Sig &sig);
+    void remove(const PubKey &pubkey, const uint8_t *msg, size_t len, const Sig &sig);
+
+    /*
+     * Function: check
+     * @return {bool} true iff the running aggregate signature is valid for the current signers
+     */
+    bool check();
+
+    // current aggregate signature
+    Sig aggregateSig() const;
+
+    // number of signers currently in the aggregate
+    size_t size() const;
+
+    private:
+    Bls &bls;
+    Fp12 miller_prod;
+    Ec1 agg_sig;
+    size_t count;
   };
 }
+
+#endif
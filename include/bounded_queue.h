@@ -0,0 +1,120 @@
+/*
+ * Blocking queue with a fixed capacity, used to connect pipeline stages
+ * Keeps depth and stall counters so the stage ratio can be tuned
+ */
+
+#ifndef BLS_BOUNDED_QUEUE
+#define BLS_BOUNDED_QUEUE
+
+#include <queue>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+
+namespace bls {
+  template<class T>
+  class BoundedQueue {
+    public:
+
+    BoundedQueue(size_t capacity) :
+      capacity(capacity == 0 ? 1 : capacity), closed(false),
+      max_depth(0), depth_sum(0), pushes(0), push_stalls(0), pop_stalls(0) {}
+
+    /*
+     * Function: push, wait for room in the queue and add item
+     * @param {const T&} item
+     * @return {bool} false if the queue was closed and item was dropped
+     */
+    bool push(const T &item) {
+      std::unique_lock<std::mutex> lock(mutex);
+
+      if(!closed && items.size() >= capacity) push_stalls++;
+      not_full.wait(lock, [this] { return closed || items.size() < capacity; });
+      if(closed) return false;
+
+      items.push(item);
+      pushes++;
+      depth_sum += items.size();
+      if(items.size() > max_depth) max_depth = items.size();
+
+      lock.unlock();
+      not_empty.notify_one();
+      return true;
+    }
+
+    /*
+     * Function: pop, wait for an item
+     * @param {T&} item, populated with the oldest item
+     * @return {bool} false once the queue is closed and drained
+     */
+    bool pop(T &item) {
+      std::unique_lock<std::mutex> lock(mutex);
+
+      if(!closed && items.empty()) pop_stalls++;
+      not_empty.wait(lock, [this] { return closed || !items.empty(); });
+      if(items.empty()) return false;
+
+      item = items.front();
+      items.pop();
+
+      lock.unlock();
+      not_full.notify_one();
+      return true;
+    }
+
+    /*
+     * Function: close, stop accepting items and wake all waiting threads
+     * Items already queued can still be popped
+     */
+    void close() {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+      }
+      not_full.notify_all();
+      not_empty.notify_all();
+    }
+
+    size_t getCapacity() const { return capacity; }
+
+    // deepest the queue has been
+    size_t maxDepth() {
+      std::lock_guard<std::mutex> lock(mutex);
+      return max_depth;
+    }
+
+    // mean depth right after each push
+    double avgDepth() {
+      std::lock_guard<std::mutex> lock(mutex);
+      return pushes == 0 ? 0.0 : (double)depth_sum / pushes;
+    }
+
+    // pushes that had to wait for a full queue
+    uint64_t pushStalls() {
+      std::lock_guard<std::mutex> lock(mutex);
+      return push_stalls;
+    }
+
+    // pops that had to wait for an empty queue
+    uint64_t popStalls() {
+      std::lock_guard<std::mutex> lock(mutex);
+      return pop_stalls;
+    }
+
+    private:
+    const size_t capacity;
+    std::queue<T> items;
+    std::mutex mutex;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+    bool closed;
+
+    size_t max_depth;
+    uint64_t depth_sum;
+    uint64_t pushes;
+    uint64_t push_stalls;
+    uint64_t pop_stalls;
+  };
+}
+
+#endif
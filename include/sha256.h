@@ -2,6 +2,7 @@
 #ifndef SHA256_H
 #define SHA256_H
 #include <string>
+#include <cstddef>
 
 class SHA256
 {
@@ -18,6 +19,21 @@ public:
     void final(unsigned char *digest);
     static const unsigned int DIGEST_SIZE = ( 256 / 8);
 
+    /*
+     * Function: hashMany, finish n independent hashes at once
+     * Hash i continues from a copy of *states[i], absorbs lens[i] bytes of messages[i] and is
+     * finalized into digests + i * DIGEST_SIZE, the states themselves are not modified.
+     * On CPUs with AVX-512 (16 lanes) or AVX2 (8 lanes) each compression step runs one block of
+     * several hashes side by side, otherwise every hash runs through the scalar transform
+     * @param {size_t} max_lanes, caps the lanes used, 1 forces the scalar transform
+     * @return {unsigned int} lanes used
+     */
+    static unsigned int hashMany(const SHA256 *const *states, const unsigned char *const *messages,
+        const size_t *lens, size_t n, unsigned char *digests, size_t max_lanes = 16);
+
+    // lanes of the widest engine this CPU supports, 1 without AVX2
+    static unsigned int lanes();
+
 protected:
     void transform(const unsigned char *message, unsigned int block_nb);
     unsigned int m_tot_len;
@@ -0,0 +1,59 @@
+/*
+ * Fixed size worker pool used to spread verification work over several cores
+ */
+
+#ifndef BLS_THREAD_POOL
+#define BLS_THREAD_POOL
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+
+namespace bls {
+  class ThreadPool {
+    public:
+
+    /*
+     * Constructor: start num_threads worker threads
+     * @param {size_t} num_threads, number of workers (at least 1)
+     */
+    ThreadPool(size_t num_threads);
+
+    /*
+     * Destructor: finish queued tasks and join the workers
+     */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /*
+     * Function: submit, queue a task for the workers
+     * @param {function<void()>} task, work to run
+     * @return {future<void>} ready once the task ran, rethrows any exception it threw
+     */
+    std::future<void> submit(std::function<void()> task);
+
+    /*
+     * Function: size
+     * @return {size_t} number of worker threads
+     */
+    size_t size() const;
+
+    private:
+
+    void workerLoop();
+
+    std::vector<std::thread> workers;
+    std::queue<std::packaged_task<void()> > tasks;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stopping;
+  };
+}
+
+#endif
@@ -0,0 +1,87 @@
+/*
+ * Bounded, concurrent cache of successful signature verifications
+ * Keys are opaque byte strings, compared in full on lookup. Bls uses fixed size SHA256
+ * digests of the triples (see Bls::tripleKey), so memory is bounded by the capacity
+ */
+
+#ifndef BLS_VERIFY_CACHE
+#define BLS_VERIFY_CACHE
+
+#include <string>
+#include <list>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+
+namespace bls {
+  class VerifyCache {
+    public:
+
+    /*
+     * Constructor
+     * @param {size_t} capacity, maximum number of entries, least recently used entries are evicted
+     * @param {size_t} num_shards, independently locked shards, more shards mean less lock contention
+     */
+    VerifyCache(size_t capacity, size_t num_shards=16);
+
+    /*
+     * Function: contains, look up a key and mark it as recently used
+     * @param {string&} key
+     * @return {bool} true iff the key is cached
+     */
+    bool contains(const std::string &key);
+
+    /*
+     * Function: insert, add a key, evicting the least recently used entry of its shard when full
+     * @param {string&} key
+     */
+    void insert(const std::string &key);
+
+    // drop all entries, counters are kept
+    void clear();
+
+    // number of cached entries
+    size_t size();
+
+    uint64_t hits() const;
+    uint64_t misses() const;
+    uint64_t evictions() const;
+
+    /*
+     * Function: saveSnapshot, write all entries to a file
+     * @param {const char*} path
+     * @return {bool} false if the file could not be written
+     */
+    bool saveSnapshot(const char *path);
+
+    /*
+     * Function: loadSnapshot, insert the entries of a file written by saveSnapshot
+     * Every loaded entry is treated as a verified signature, so only load snapshots from trusted storage
+     * @param {const char*} path
+     * @return {size_t} number of entries loaded
+     */
+    size_t loadSnapshot(const char *path);
+
+    private:
+
+    typedef struct shard {
+      std::mutex mutex;
+      std::list<std::string> lru;  // most recently used first
+      std::unordered_map<std::string, std::list<std::string>::iterator> entries;
+    } shard;
+
+    shard &shardFor(const std::string &key);
+
+    size_t shard_capacity;
+    std::vector<std::unique_ptr<shard> > shards;
+
+    std::atomic<uint64_t> num_hits;
+    std::atomic<uint64_t> num_misses;
+    std::atomic<uint64_t> num_evictions;
+  };
+}
+
+#endif
@@ -0,0 +1,166 @@
+/*
+ * Priority scheduler for verification requests
+ * High priority requests (block proposals) are run one at a time in deadline order as soon as a
+ * worker is free, low priority requests (historical sync) are collected and checked together
+ * with Bls::verifyBatch
+ */
+
+#ifndef BLS_VERIFY_SCHEDULER
+#define BLS_VERIFY_SCHEDULER
+
+#include "bls.h"
+#include <vector>
+#include <string>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <chrono>
+#include <memory>
+#include <stdint.h>
+
+namespace bls {
+  enum VerifyPriority {
+    PRIORITY_HIGH,
+    PRIORITY_LOW
+  };
+
+  /*
+   * Worker and batching limits of a VerifyScheduler
+   */
+  typedef struct schedulerConfig {
+    size_t num_workers;         // worker threads (at least 1)
+    size_t reserved_workers;    // workers that only run high priority requests, keeps one free for proposals
+    size_t max_batch;           // most low priority signatures checked in one verifyBatch call
+    uint64_t batch_wait_us;     // longest a low priority request waits for its batch to fill up
+  } schedulerConfig;
+
+  /*
+   * Counters of a VerifyScheduler since it was created
+   */
+  typedef struct schedulerStats {
+    uint64_t high_requests;         // finished high priority requests
+    uint64_t low_requests;          // finished low priority requests
+    uint64_t high_deadline_misses;  // high priority requests finished after their deadline
+    uint64_t low_deadline_misses;   // low priority requests finished after their deadline
+    double avg_high_wait_us;        // mean time from submit to a worker picking the request up
+    double max_high_wait_us;
+    double avg_low_wait_us;
+    double max_low_wait_us;
+    uint64_t low_batches;           // verifyBatch calls made for the low priority lane
+    double avg_low_batch_size;
+  } schedulerStats;
+
+  class VerifyScheduler {
+    public:
+
+    typedef std::chrono::steady_clock clock;
+
+    /*
+     * Constructor: start the workers
+     * @param {Bls&} bls, used for every verification, must outlive the scheduler
+     * @param {schedulerConfig&} config, see defaultConfig()
+     */
+    VerifyScheduler(Bls &bls, const schedulerConfig &config=defaultConfig());
+
+    /*
+     * Destructor: finish every queued request and join the workers
+     */
+    ~VerifyScheduler();
+
+    VerifyScheduler(const VerifyScheduler&) = delete;
+    VerifyScheduler& operator=(const VerifyScheduler&) = delete;
+
+    // 2 workers, 1 of them reserved, batches of up to 64 collected for at most 2ms
+    static schedulerConfig defaultConfig();
+
+    /*
+     * Function: submit, queue a single signature verification
+     * The message is copied, so the triple need not outlive the call
+     * @param {sigTriple&} triple, signature to check
+     * @param {VerifyPriority} priority, lane to queue the request in
+     * @param {clock::time_point} deadline, requests in a lane are run earliest deadline first
+     * @return {future<bool>} result of the verification
+     */
+    std::future<bool> submit(const sigTriple &triple, VerifyPriority priority,
+      clock::time_point deadline=clock::time_point::max());
+
+    // binary message variant, msg may contain NUL bytes
+    std::future<bool> submit(const PubKey &pubkey, const uint8_t *msg, size_t len, const Sig &sig,
+      VerifyPriority priority, clock::time_point deadline=clock::time_point::max());
+
+    /*
+     * Function: submitAgg, queue an aggregate signature verification
+     * Aggregates are never batched with other requests, the messages are copied
+     * @param {vector<char*>&} messages, one message per signer
+     * @param {vector<PubKey>&} pubkeys, one pubkey per message
+     * @param {Sig&} sig, aggregate signature
+     * @param {VerifyPriority} priority, lane to queue the request in
+     * @param {clock::time_point} deadline
+     * @return {future<bool>} result of the verification
+     */
+    std::future<bool> submitAgg(const std::vector<const char*> &messages, const std::vector<PubKey> &pubkeys,
+      const Sig &sig, VerifyPriority priority, clock::time_point deadline=clock::time_point::max());
+    std::future<bool> submitAgg(const msgArena &messages, const std::vector<PubKey> &pubkeys,
+      const Sig &sig, VerifyPriority priority, clock::time_point deadline=clock::time_point::max());
+
+    /*
+     * Function: stats, snapshot of the wait time and deadline counters
+     * @return {schedulerStats}
+     */
+    schedulerStats stats();
+
+    private:
+
+    typedef struct request {
+      VerifyPriority priority;
+      clock::time_point deadline;
+      clock::time_point enqueued;
+      uint64_t seq;                       // submission order, breaks deadline ties
+      MessageBuffer messages;             // one message for single signatures
+      std::vector<PubKey> pubkeys;
+      Ec1 sig;
+      std::promise<bool> result;
+    } request;
+
+    // earliest deadline on top of the heap
+    struct laterDeadline {
+      bool operator()(const std::shared_ptr<request> &a, const std::shared_ptr<request> &b) const {
+        if(a->deadline != b->deadline) return a->deadline > b->deadline;
+        return a->seq > b->seq;
+      }
+    };
+
+    typedef std::priority_queue<std::shared_ptr<request>, std::vector<std::shared_ptr<request> >, laterDeadline> lane;
+
+    std::future<bool> enqueue(std::shared_ptr<request> req);
+    void workerLoop(bool reserved);
+
+    // run the requests and fulfill their promises, locks the mutex to record counters
+    void runOne(std::shared_ptr<request> req);
+    void runBatch(std::vector<std::shared_ptr<request> > &reqs);
+    void finish(request &req, bool valid, clock::time_point done);
+
+    Bls &bls;
+    schedulerConfig config;
+
+    std::vector<std::thread> workers;
+    lane high_lane;
+    lane low_lane;
+    clock::time_point low_since;  // when the oldest request of the current low batch arrived
+    uint64_t next_seq;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stopping;
+
+    // guarded by mutex
+    schedulerStats counters;
+    uint64_t high_started;  // requests taken off each lane
+    uint64_t low_started;
+    double high_wait_sum;
+    double low_wait_sum;
+  };
+}
+
+#endif
@@ -0,0 +1,98 @@
+#include "aggregation_pool.h"
+
+namespace bls {
+  AggregationPool::AggregationPool(Bls &bls, const aggregationPoolConfig &config,
+    std::function<void(const poolFlush&)> on_flush) : bls(bls), config(config), on_flush(on_flush) {
+    if(this->config.max_size == 0) this->config.max_size = 1;
+    counters = aggregationPoolStats();
+  }
+
+  bool AggregationPool::add(const PubKey &pubkey, const char* msg, const Sig &sig) {
+    return add(pubkey, (const uint8_t*)msg, strlen(msg), sig);
+  }
+
+  bool AggregationPool::add(const PubKey &pubkey, const uint8_t *msg, size_t len, const Sig &sig) {
+    poll();
+
+    std::string key = bls.tripleKey(pubkey.ec2, msg, len, sig.ec1);
+    if(!pending_keys.insert(key).second) {
+      counters.duplicates++;
+      return false;
+    }
+
+    if(pending.empty()) oldest = clock::now();
+    pending.push_back({pubkey, std::string((const char*)msg, len), sig});
+
+    if(pending.size() >= config.max_size) flush();
+
+    return true;
+  }
+
+  bool AggregationPool::poll() {
+    if(pending.empty()) return false;
+    if(clock::now() - oldest < std::chrono::microseconds(config.max_age_us)) return false;
+
+    flush();
+    return true;
+  }
+
+  void AggregationPool::flush() {
+    if(pending.empty()) return;
+
+    // take the batch first, so on_flush may add to the pool again
+    std::vector<poolEntry> batch;
+    batch.swap(pending);
+    pending_keys.clear();
+
+    MessageBuffer messages;
+    std::vector<PubKey> pubkeys;
+    std::vector<Sig> sigs;
+    for(size_t i=0; i < batch.size(); i++) {
+      messages.add(batch[i].msg);
+      pubkeys.push_back(batch[i].pubkey);
+      sigs.push_back(batch[i].sig);
+    }
+
+    poolFlush result;
+    result.agg_sig = bls.aggregateSigs(sigs).ec1;
+    result.optimistic = bls.verifyAggSig(messages.arena(), pubkeys, Sig(result.agg_sig));
+    counters.flushes++;
+
+    if(result.optimistic) {
+      counters.optimistic_successes++;
+      result.included.swap(batch);
+    } else {
+      // find the bad signatures by bisection and aggregate the rest
+      counters.fallbacks++;
+
+      std::vector<size_t> bad_indices;
+      bls.verifyBatch(messages.arena(), pubkeys, sigs, bad_indices);
+
+      std::vector<bool> bad(batch.size(), false);
+      for(size_t i=0; i < bad_indices.size(); i++) bad[bad_indices[i]] = true;
+
+      result.agg_sig.clear();
+      for(size_t i=0; i < batch.size(); i++) {
+        if(bad[i]) {
+          result.rejected.push_back(batch[i]);
+        } else {
+          result.agg_sig += batch[i].sig.ec1;
+          result.included.push_back(batch[i]);
+        }
+      }
+      counters.rejected += result.rejected.size();
+    }
+
+    on_flush(result);
+  }
+
+  size_t AggregationPool::size() const {
+    return pending.size();
+  }
+
+  aggregationPoolStats AggregationPool::stats() const {
+    aggregationPoolStats out = counters;
+    out.optimistic_rate = counters.flushes ? (double)counters.optimistic_successes / counters.flushes : 0;
+    return out;
+  }
+}
@@ -26,6 +26,64 @@ namespace bls {
 
     g1 = g1p;
     g2 = g2p;
+
+    // every verification pairs g2 with a signature, so its lines are computed once
+    Ec2 g2_normalized;
+    bn::precomputeG2(g2_coeff, g2_normalized, g2);
+
+    hash_suite.store(HASH_TRY_AND_INCREMENT);
+
+    // p = 1 mod 3, so -3 is a square
+    Fp::squareRoot(svdw_sqrt_neg3, Fp(0) - Fp(3));
+    svdw_c1 = (svdw_sqrt_neg3 - Fp(1)) / Fp(2);
+
+    // 2^i for every bit length of a digest
+    pow2_table.resize(8 * SHA256::DIGEST_SIZE + 1);
+    pow2_table[0] = Fp(1);
+    for(size_t i=1; i < pow2_table.size(); i++) {
+      pow2_table[i] = pow2_table[i - 1] + pow2_table[i - 1];
+    }
+  }
+
+  void Bls::setNumThreads(size_t num_threads) {
+    if(num_threads <= 1) {
+      pool.reset();
+    } else {
+      pool = std::make_shared<ThreadPool>(num_threads);
+    }
+  }
+
+  size_t Bls::getNumThreads() const {
+    return pool ? pool->size() : 1;
+  }
+
+  void Bls::setVerifyCache(std::shared_ptr<VerifyCache> cache) {
+    verify_cache = cache;
+  }
+
+  std::shared_ptr<VerifyCache> Bls::getVerifyCache() const {
+    return verify_cache;
+  }
+
+  void Bls::setHashSuite(HashSuite suite) {
+    hash_suite.store(suite);
+  }
+
+  HashSuite Bls::getHashSuite() const {
+    return hash_suite.load();
+  }
+
+  void Bls::setLowLatency(bool enabled) {
+    // verifySigLowLatency keeps its own reference, so a pool being replaced finishes its work first
+    if(enabled) {
+      if(std::atomic_load(&latency_pool)) return;
+
+      // one worker for e(g, sig), one for the pubkey line coefficients
+      std::shared_ptr<ThreadPool> empty;
+      std::atomic_compare_exchange_strong(&latency_pool, &empty, std::make_shared<ThreadPool>(2));
+    } else {
+      std::atomic_store(&latency_pool, std::shared_ptr<ThreadPool>());
+    }
   }
 
   PubKey Bls::genPubKey(const char *seed) {
@@ -38,276 +96,1914 @@ namespace bls {
     } else if (s_secret_key >= Param::p) {
       throw std::invalid_argument("Secret key too large");
     }
-
-    mie::Vuint secret_key(s_secret_key.toString());
-    return genPubKey(secret_key);
+
+    mie::Vuint secret_key(s_secret_key.toString());
+    return genPubKey(secret_key);
+  }
+
+  PubKey Bls::genPubKey(const std::string& seed) {
+    return genPubKey(seed.c_str());
+  }
+
+  PubKey Bls::genPubKey(mie::Vuint secret_key) {
+    // Multiply generator by pk
+    Ec2 public_key_point = g2 * secret_key;
+    return PubKey(public_key_point);
+  }
+
+  Sig Bls::aggregateSigs(const std::vector<Sig>& sigs) {
+    Ec1 sig_product = sigs[0].ec1;
+
+    for(size_t i=1; i < sigs.size(); i++) {
+      sig_product = sig_product + sigs[i].ec1;
+    }
+
+    return Sig(sig_product);
+  }
+
+  bool Bls::verifySigSignAgnostic(PubKey const &pubkey, const char* msg, Sig const &sig) {
+    return verifySigSignAgnostic(pubkey, (const uint8_t*)msg, strlen(msg), sig);
+  }
+
+  bool Bls::verifySigSignAgnostic(PubKey const &pubkey, const uint8_t *msg, size_t len, Sig const &sig) {
+    if(verifySig(pubkey, msg, len, sig)) return true;
+    // flip
+    Ec1 negEc1 = sig.ec1;
+    negEc1.p[1] = -negEc1.p[1];
+    return verifySig(pubkey, msg, len, Sig(negEc1));
+  }
+
+  bool Bls::verifySig(PubKey const &pubkey, const char* msg, Ec1 sigEc1, bool delay_exp) {
+    return verifySig(pubkey, (const uint8_t*)msg, strlen(msg), Sig(sigEc1), delay_exp);
+  }
+
+  bool Bls::verifySig(PubKey const &pubkey, const std::string &msg, const Sig &sig, bool delay_exp) {
+    return verifySig(pubkey, (const uint8_t*)msg.data(), msg.size(), sig, delay_exp);
+  }
+
+  bool Bls::verifySig(PubKey const &pubkey, const uint8_t *msg, size_t len, const Sig &sig, bool delay_exp) {
+    std::string cache_key;
+    if(verify_cache) {
+      cache_key = tripleKey(pubkey.ec2, msg, len, sig.ec1);
+      if(verify_cache->contains(cache_key)) return true;
+    }
+
+    bool valid = verifySigUncached(pubkey, msg, len, sig.ec1, delay_exp);
+
+    if(valid && verify_cache) {
+      verify_cache->insert(cache_key);
+    }
+
+    return valid;
+  }
+
+  bool Bls::verifySigUncached(PubKey const &pubkey, const uint8_t *msg, size_t len, Ec1 sigEc1, bool delay_exp) {
+    // ~100 us
+    Ec1 hashed_msg_point = hashMsgWithPubkey(msg, len, pubkey.ec2);
+
+    if(!delay_exp) {
+      Fp12 pairing_1; // e(g, H(m)^sk)
+      Fp12 pairing_2; // e(g^sk, H(m))
+
+      // check pairing equality
+      // e(g, H(m)^alpha) == e(g^alpha (pubkey), H(m)) 
+
+      // ~500 us
+      bn::millerLoop(pairing_1, g2_coeff, sigEc1);
+      pairing_1.final_exp();
+
+      // ~500 us
+      opt_atePairing(pairing_2, pubkey.ec2, hashed_msg_point);
+
+      return pairing_1 == pairing_2;
+    }
+
+    // check e(g, H(m)^alpha) * e(g^alpha (pubkey), -H(m)) == 1
+    // with a single final exponentiation applied to the product of both Miller loops
+    Ec1 neg_hashed_msg_point = hashed_msg_point;
+    neg_hashed_msg_point.p[1] = -neg_hashed_msg_point.p[1];
+
+    Ec1 g1_points[2] = {sigEc1, neg_hashed_msg_point};
+    Ec2 g2_points[2] = {g2, pubkey.ec2};
+
+    return multiPairingIsOne(g1_points, g2_points, 2);
+  }
+
+  bool Bls::verifySig(PubKey const &pubkey, const char* msg, Sig const &sig, bool delay_exp) {
+    return verifySig(pubkey, msg, sig.ec1, delay_exp);
+  }
+
+  bool Bls::verifySig(PreparedPubKey const &pubkey, const char* msg, const Sig &sig) {
+    return verifySig(pubkey, (const uint8_t*)msg, strlen(msg), sig);
+  }
+
+  bool Bls::verifySig(PreparedPubKey const &pubkey, const std::string &msg, const Sig &sig) {
+    return verifySig(pubkey, (const uint8_t*)msg.data(), msg.size(), sig);
+  }
+
+  bool Bls::verifySig(PreparedPubKey const &pubkey, const uint8_t *msg, size_t len, const Sig &sig) {
+    // prepared keys share the cache of verifySig(PubKey)
+    std::string cache_key;
+    if(verify_cache) {
+      cache_key = tripleKey(pubkey.ec2, msg, len, sig.ec1);
+      if(verify_cache->contains(cache_key)) return true;
+    }
+
+    Ec1 neg_hashed_msg_point = hashMsgWithPubkey(msg, len, pubkey);
+    neg_hashed_msg_point.p[1] = -neg_hashed_msg_point.p[1];
+
+    // only the G1 side is evaluated for the pubkey, its lines are precomputed
+    Ec1 g1_points[2] = {sig.ec1, neg_hashed_msg_point};
+    Ec2 g2_points[2] = {g2, pubkey.ec2};
+    const std::vector<Fp6>* g2_lines[2] = {&g2_coeff, &pubkey.coeff};
+
+    bool valid = multiPairingIsOne(g1_points, g2_points, 2, g2_lines);
+
+    if(valid && verify_cache) {
+      verify_cache->insert(cache_key);
+    }
+
+    return valid;
+  }
+
+  bool Bls::verifySigLowLatency(PubKey const &pubkey, const char* msg, const Sig &sig) {
+    return verifySigLowLatency(pubkey, (const uint8_t*)msg, strlen(msg), sig);
+  }
+
+  bool Bls::verifySigLowLatency(PubKey const &pubkey, const uint8_t *msg, size_t len, const Sig &sig) {
+    std::shared_ptr<ThreadPool> workers = std::atomic_load(&latency_pool);
+    if(!workers) return verifySig(pubkey, msg, len, sig);
+
+    std::string cache_key;
+    if(verify_cache) {
+      cache_key = tripleKey(pubkey.ec2, msg, len, sig.ec1);
+      if(verify_cache->contains(cache_key)) return true;
+    }
+
+    // neither e(g, sig) nor the line coefficients of pubkey depend on the hash,
+    // so both run on the workers while this thread hashes the message
+    Fp12 miller_1;
+    std::future<void> sig_done = workers->submit([this, &miller_1, &sig]() {
+      miller_1 = multiMillerLoop(&sig.ec1, &g2, 1);
+    });
+
+    std::vector<Fp6> pubkey_coeff;
+    Ec2 pubkey_point;
+    std::future<void> lines_done;
+
+    Fp12 miller_2;
+    try {
+      lines_done = workers->submit([&pubkey_coeff, &pubkey_point, &pubkey]() {
+        bn::precomputeG2(pubkey_coeff, pubkey_point, pubkey.ec2);
+      });
+
+      Ec1 neg_hashed_msg_point = hashMsgWithPubkey(msg, len, pubkey.ec2);
+      neg_hashed_msg_point.p[1] = -neg_hashed_msg_point.p[1];
+
+      // only the G1 side is left once the lines are ready
+      lines_done.get();
+      const std::vector<Fp6>* pubkey_lines = &pubkey_coeff;
+      miller_2 = multiMillerLoop(&neg_hashed_msg_point, &pubkey_point, 1, &pubkey_lines);
+    } catch(...) {
+      // the workers still reference this frame
+      sig_done.wait();
+      if(lines_done.valid()) lines_done.wait();
+      throw;
+    }
+
+    sig_done.get();
+
+    miller_1 *= miller_2;
+    miller_1.final_exp();
+
+    bool valid = miller_1 == Fp12(1);
+
+    if(valid && verify_cache) {
+      verify_cache->insert(cache_key);
+    }
+
+    return valid;
+  }
+
+  Sig Bls::signMsg(const char *msg, const char *secret_key_str, const PubKey &pubkey) {
+    const mie::Vuint secret_key(secret_key_str);
+    return signMsg(msg, secret_key, pubkey);
+  }
+
+  Sig Bls::signMsg(const char *msg, const mie::Vuint secret_key, const PubKey &pubkey) {
+    return signMsg((const uint8_t*)msg, strlen(msg), secret_key, pubkey);
+  }
+
+  Sig Bls::signMsg(std::string& msg, const mie::Vuint secret_key, const PubKey &pubkey) {
+    return signMsg((const uint8_t*)msg.data(), msg.size(), secret_key, pubkey);
+  }
+
+  Sig Bls::signMsg(const uint8_t *msg, size_t len, const mie::Vuint secret_key, const PubKey &pubkey) {
+    Ec1 hashed_msg_point = hashMsgWithPubkey(msg, len, pubkey.ec2);
+    return Sig(hashed_msg_point * secret_key);
+  }
+
+  bool Bls::verifyAggSig(const std::vector<const char*> &messages, const std::vector<PubKey> &pubkeys, const Sig &sig,
+    bool delay_exp, bool group_keys) {
+    // check that same number of messages and pubkeys
+    if(messages.size() != pubkeys.size()) {
+      cerr << "SIZES NOT EQUAL" << endl;
+      return false;
+    }
+
+    return verifyAggRefs(toMsgRefs(messages), pubkeys, sig, delay_exp, group_keys);
+  }
+
+  bool Bls::verifyAggSig(const std::vector<const char*> &messages, const std::vector<const PreparedPubKey*> &pubkeys, const Sig &sig,
+    bool delay_exp, bool group_keys) {
+    // check that same number of messages and pubkeys
+    if(messages.size() != pubkeys.size()) {
+      cerr << "SIZES NOT EQUAL" << endl;
+      return false;
+    }
+
+    return verifyAggRefs(toMsgRefs(messages), pubkeys, sig, delay_exp, group_keys);
+  }
+
+  bool Bls::verifyAggSig(const std::vector<const char*> &messages, const std::vector<PubKey> &pubkeys, const Sig &sig,
+    const pipelineConfig &config, pipelineStats *stats) {
+    // check that same number of messages and pubkeys
+    if(messages.size() != pubkeys.size()) {
+      cerr << "SIZES NOT EQUAL" << endl;
+      return false;
+    }
+
+    return verifyAggRefs(toMsgRefs(messages), pubkeys, sig, config, stats);
+  }
+
+  bool Bls::verifyAggSig(const msgArena &messages, const std::vector<PubKey> &pubkeys, const Sig &sig,
+    bool delay_exp, bool group_keys) {
+    return verifyAggRefs(arenaRefs(messages, pubkeys.size()), pubkeys, sig, delay_exp, group_keys);
+  }
+
+  bool Bls::verifyAggSig(const msgArena &messages, const std::vector<const PreparedPubKey*> &pubkeys, const Sig &sig,
+    bool delay_exp, bool group_keys) {
+    return verifyAggRefs(arenaRefs(messages, pubkeys.size()), pubkeys, sig, delay_exp, group_keys);
+  }
+
+  bool Bls::verifyAggSig(const msgArena &messages, const std::vector<PubKey> &pubkeys, const Sig &sig,
+    const pipelineConfig &config, pipelineStats *stats) {
+    return verifyAggRefs(arenaRefs(messages, pubkeys.size()), pubkeys, sig, config, stats);
+  }
+
+  bool Bls::verifyAggRefs(const std::vector<msgRef> &messages, const std::vector<PubKey> &pubkeys, const Sig &sig,
+    bool delay_exp, bool group_keys) {
+    // callers check that there is one message per pubkey
+    // one Miller loop per distinct pubkey
+    std::vector<const Ec2*> keys;
+    for(size_t i=0; i < pubkeys.size(); i++) keys.push_back(&pubkeys[i].ec2);
+    std::vector<std::vector<size_t> > groups;
+    groupByPubKey(keys, group_keys, groups);
+
+    // with a worker pool each shard is hashed and Miller-looped into a partial product
+    Fp12 pairing_prod = parallelProduct(groups.size(), [&](size_t begin, size_t end) {
+      return aggMillerProduct(messages, pubkeys, groups, begin, end, delay_exp);
+    }, pool.get());
+
+    if(!delay_exp) {
+      // calculate pairing with agg signature
+      Fp12 pairing_agg;
+      bn::millerLoop(pairing_agg, g2_coeff, sig.ec1);
+      pairing_agg.final_exp();
+
+      return pairing_agg == pairing_prod;
+    }
+
+    // e(g, -sig) joins the product before the shared final exponentiation
+    Ec1 neg_sig = sig.ec1;
+    neg_sig.p[1] = -neg_sig.p[1];
+    pairing_prod *= multiMillerLoop(&neg_sig, &g2, 1);
+
+    pairing_prod.final_exp();
+
+    return pairing_prod == Fp12(1);
+  }
+
+  bool Bls::verifyAggRefs(const std::vector<msgRef> &refs, const std::vector<const PreparedPubKey*> &pubkeys, const Sig &sig,
+    bool delay_exp, bool group_keys) {
+    std::vector<const Ec2*> keys;
+    for(size_t i=0; i < pubkeys.size(); i++) keys.push_back(&pubkeys[i]->ec2);
+    std::vector<std::vector<size_t> > groups;
+    groupByPubKey(keys, group_keys, groups);
+
+    // prod e(pubkey_g, sum H(m_i)) using the precomputed lines
+    Fp12 pairing_prod = parallelProduct(groups.size(), [&](size_t begin, size_t end) {
+      std::vector<Ec1> hashed_sums;
+      std::vector<Ec2> keys;
+      std::vector<const std::vector<Fp6>*> lines;
+
+      // every message of the shard in one multi-buffer pass, from the midstate of its key
+      std::vector<const SHA256*> msg_prefixes;
+      std::vector<msgRef> msgs;
+      for(size_t g=begin; g < end; g++) {
+        for(size_t j=0; j < groups[g].size(); j++) {
+          msg_prefixes.push_back(&pubkeys[groups[g][j]]->hash_prefix);
+          msgs.push_back(refs[groups[g][j]]);
+        }
+      }
+
+      std::vector<Ec1> hashed_points;
+      hashMsgs(msg_prefixes, msgs, hashed_points);
+
+      size_t next = 0;
+      for(size_t g=begin; g < end; g++) {
+        const PreparedPubKey &pubkey = *pubkeys[groups[g][0]];
+        Ec1 hashed_sum = hashed_points[next++];
+        for(size_t j=1; j < groups[g].size(); j++) {
+          hashed_sum += hashed_points[next++];
+        }
+
+        hashed_sums.push_back(hashed_sum);
+        keys.push_back(pubkey.ec2);
+        lines.push_back(&pubkey.coeff);
+      }
+      if(delay_exp) return multiMillerLoop(hashed_sums, keys, &lines);
+
+      // legacy path, every group gets its own final exponentiation
+      Fp12 range_prod(1);
+      for(size_t g=0; g < keys.size(); g++) {
+        Fp12 pairing_g = multiMillerLoop(&hashed_sums[g], &keys[g], 1, &lines[g]);
+        pairing_g.final_exp();
+        range_prod *= pairing_g;
+      }
+      return range_prod;
+    }, pool.get());
+
+    if(!delay_exp) {
+      Fp12 pairing_agg;
+      bn::millerLoop(pairing_agg, g2_coeff, sig.ec1);
+      pairing_agg.final_exp();
+
+      return pairing_agg == pairing_prod;
+    }
+
+    // e(g, -sig)
+    Ec1 neg_sig = sig.ec1;
+    neg_sig.p[1] = -neg_sig.p[1];
+    pairing_prod *= multiMillerLoop(&neg_sig, &g2, 1);
+
+    pairing_prod.final_exp();
+
+    return pairing_prod == Fp12(1);
+  }
+
+  bool Bls::verifyAggRefs(const std::vector<msgRef> &refs, const std::vector<PubKey> &pubkeys, const Sig &sig,
+    const pipelineConfig &config, pipelineStats *stats) {
+    std::vector<const Ec2*> keys;
+    for(size_t i=0; i < pubkeys.size(); i++) keys.push_back(&pubkeys[i].ec2);
+    std::vector<std::vector<size_t> > groups;
+    groupByPubKey(keys, true, groups);
+
+    const size_t hash_threads = std::max<size_t>(config.hash_threads, 1);
+    const size_t miller_threads = std::max<size_t>(config.miller_threads, 1);
+
+    // (group, sum of its hashed messages)
+    typedef std::pair<size_t, Ec1> hashedGroup;
+    BoundedQueue<hashedGroup> queue(config.queue_capacity);
+
+    // hashers claim enough groups at a time to fill the lanes of SHA256::hashMany
+    const size_t claim = SHA256::lanes();
+    std::atomic<size_t> next_group(0);
+    std::atomic<size_t> active_hashers(hash_threads);
+    std::vector<Fp12> partials(miller_threads, Fp12(1));
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    std::vector<std::thread> threads;
+
+    // stage 1: hash each group's messages onto the curve
+    for(size_t t=0; t < hash_threads; t++) {
+      threads.push_back(std::thread([&]() {
+        try {
+          bool open = true;
+          for(size_t begin = next_group.fetch_add(claim); open && begin < groups.size(); begin = next_group.fetch_add(claim)) {
+            size_t end = std::min(begin + claim, groups.size());
+
+            std::vector<SHA256> prefixes;
+            std::vector<const SHA256*> msg_prefixes;
+            std::vector<msgRef> msgs;
+            prefixes.reserve(end - begin);
+            for(size_t g=begin; g < end; g++) {
+              prefixes.push_back(pubkeyHashPrefix(pubkeys[groups[g][0]].ec2));
+              for(size_t j=0; j < groups[g].size(); j++) {
+                msg_prefixes.push_back(&prefixes.back());
+                msgs.push_back(refs[groups[g][j]]);
+              }
+            }
+
+            std::vector<Ec1> hashed_points;
+            hashMsgs(msg_prefixes, msgs, hashed_points);
+
+            size_t next = 0;
+            for(size_t g=begin; open && g < end; g++) {
+              Ec1 hashed_sum = hashed_points[next++];
+              for(size_t j=1; j < groups[g].size(); j++) {
+                hashed_sum += hashed_points[next++];
+              }
+
+              open = queue.push(hashedGroup(g, hashed_sum));
+            }
+          }
+        } catch(...) {
+          std::lock_guard<std::mutex> lock(error_mutex);
+          if(!error) error = std::current_exception();
+        }
+
+        // the last hasher to finish lets the Miller stage drain and stop
+        if(--active_hashers == 0) queue.close();
+      }));
+    }
+
+    // stage 2: Miller loop the hashed points as they arrive
+    for(size_t t=0; t < miller_threads; t++) {
+      threads.push_back(std::thread([&, t]() {
+        try {
+          hashedGroup item;
+          while(queue.pop(item)) {
+            partials[t] *= multiMillerLoop(&item.second, &pubkeys[groups[item.first][0]].ec2, 1);
+          }
+        } catch(...) {
+          {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if(!error) error = std::current_exception();
+          }
+          // unblock hashers waiting on a full queue, the result is discarded anyway
+          queue.close();
+        }
+      }));
+    }
+
+    for(size_t t=0; t < threads.size(); t++) {
+      threads[t].join();
+    }
+
+    if(error) std::rethrow_exception(error);
+
+    if(stats != NULL) {
+      stats->queue_capacity = queue.getCapacity();
+      stats->max_queue_depth = queue.maxDepth();
+      stats->avg_queue_depth = queue.avgDepth();
+      stats->hash_stalls = queue.pushStalls();
+      stats->miller_stalls = queue.popStalls();
+    }
+
+    Fp12 pairing_prod = partials[0];
+    for(size_t t=1; t < miller_threads; t++) {
+      pairing_prod *= partials[t];
+    }
+
+    // e(g, -sig)
+    Ec1 neg_sig = sig.ec1;
+    neg_sig.p[1] = -neg_sig.p[1];
+    pairing_prod *= multiMillerLoop(&neg_sig, &g2, 1);
+
+    pairing_prod.final_exp();
+
+    return pairing_prod == Fp12(1);
+  }
+
+  PartialProduct Bls::aggPartialProduct(const std::vector<const char*> &messages, const std::vector<PubKey> &pubkeys,
+    size_t begin, size_t end) {
+    return PartialProduct(aggRefsProduct(toMsgRefs(messages), pubkeys, begin, end));
+  }
+
+  PartialProduct Bls::aggPartialProduct(const msgArena &messages, const std::vector<PubKey> &pubkeys,
+    size_t begin, size_t end) {
+    return PartialProduct(aggRefsProduct(arenaRefs(messages, pubkeys.size()), pubkeys, begin, end));
+  }
+
+  Fp12 Bls::aggRefsProduct(const std::vector<msgRef> &messages, const std::vector<PubKey> &pubkeys, size_t begin, size_t end) {
+    if(messages.size() != pubkeys.size()) {
+      throw std::invalid_argument("Number of messages and pubkeys differ");
+    } else if(begin > end || end > messages.size()) {
+      throw std::invalid_argument("Slice out of range");
+    }
+
+    std::vector<const Ec2*> keys;
+    for(size_t i=begin; i < end; i++) keys.push_back(&pubkeys[i].ec2);
+    std::vector<std::vector<size_t> > groups;
+    groupByPubKey(keys, true, groups);
+
+    // group indices are relative to the slice
+    for(size_t g=0; g < groups.size(); g++) {
+      for(size_t j=0; j < groups[g].size(); j++) groups[g][j] += begin;
+    }
+
+    return parallelProduct(groups.size(), [&](size_t group_begin, size_t group_end) {
+      return aggMillerProduct(messages, pubkeys, groups, group_begin, group_end, true);
+    }, pool.get());
+  }
+
+  bool Bls::verifyAggPartials(const std::vector<PartialProduct> &partials, const Sig &sig) {
+    Fp12 pairing_prod(1);
+    for(size_t i=0; i < partials.size(); i++) {
+      pairing_prod *= partials[i].fp12;
+    }
+
+    // e(g, -sig)
+    Ec1 neg_sig = sig.ec1;
+    neg_sig.p[1] = -neg_sig.p[1];
+    pairing_prod *= multiMillerLoop(&neg_sig, &g2, 1);
+
+    pairing_prod.final_exp();
+
+    return pairing_prod == Fp12(1);
+  }
+
+  void Bls::writeAggRecord(std::ostream &out, const PubKey &pubkey, const char* msg) {
+    writeAggRecord(out, pubkey, (const uint8_t*)msg, strlen(msg));
+  }
+
+  void Bls::writeAggRecord(std::ostream &out, const PubKey &pubkey, const uint8_t *msg, size_t len) {
+    std::string fields[2] = {pubkey.toString(), std::string((const char*)msg, len)};
+
+    for(size_t i=0; i < 2; i++) {
+      uint32_t len = fields[i].size();
+      unsigned char len_bytes[4] = {
+        (unsigned char)len, (unsigned char)(len >> 8), (unsigned char)(len >> 16), (unsigned char)(len >> 24)
+      };
+      out.write((const char*)len_bytes, 4);
+      out.write(fields[i].data(), fields[i].size());
+    }
+  }
+
+  bool Bls::verifyAggSigStream(std::istream &records, const Sig &sig, size_t chunk_size, streamStats *stats) {
+    return verifyAggRecords([&records](char *buf, size_t n) {
+      records.read(buf, n);
+      return (size_t)records.gcount();
+    }, sig, chunk_size, stats);
+  }
+
+  bool Bls::verifyAggSigStream(const char *data, size_t len, const Sig &sig, size_t chunk_size, streamStats *stats) {
+    size_t pos = 0;
+    return verifyAggRecords([data, len, &pos](char *buf, size_t n) {
+      size_t copied = std::min(n, len - pos);
+      memcpy(buf, data + pos, copied);
+      pos += copied;
+      return copied;
+    }, sig, chunk_size, stats);
+  }
+
+  bool Bls::verifyAggRecords(const std::function<size_t(char*, size_t)> &read, const Sig &sig, size_t chunk_size, streamStats *stats) {
+    // guards against allocating for a corrupt length field
+    const uint32_t MAX_FIELD_SIZE = 1 << 24;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if(chunk_size == 0) chunk_size = 1;
+
+    Fp12 pairing_prod(1);
+    uint64_t num_records = 0;
+
+    std::vector<std::string> msg_strs;
+    std::vector<PubKey> pubkeys;
+    bool done = false;
+
+    while(!done) {
+      // read one chunk
+      while(msg_strs.size() < chunk_size) {
+        std::string fields[2];
+        for(size_t f=0; f < 2; f++) {
+          unsigned char len_bytes[4];
+          size_t got = read((char*)len_bytes, 4);
+          if(got == 0 && f == 0) {
+            done = true;
+            break;
+          } else if(got != 4) {
+            throw std::invalid_argument("Truncated aggregate record");
+          }
+
+          uint32_t len = len_bytes[0] | (len_bytes[1] << 8) | (len_bytes[2] << 16) | ((uint32_t)len_bytes[3] << 24);
+          if(len > MAX_FIELD_SIZE) {
+            throw std::invalid_argument("Aggregate record field too large");
+          }
+
+          fields[f].resize(len);
+          if(len > 0 && read(&fields[f][0], len) != len) {
+            throw std::invalid_argument("Truncated aggregate record");
+          }
+        }
+        if(done) break;
+
+        pubkeys.push_back(parseRecordPubKey(fields[0]));
+        msg_strs.push_back(fields[1]);
+      }
+
+      if(msg_strs.empty()) break;
+
+      // fold the chunk into the running product and drop it, messages may contain NUL bytes
+      std::vector<msgRef> msgs;
+      for(size_t i=0; i < msg_strs.size(); i++) {
+        msgs.push_back({(const uint8_t*)msg_strs[i].data(), msg_strs[i].size()});
+      }
+
+      pairing_prod *= aggRefsProduct(msgs, pubkeys, 0, msgs.size());
+      num_records += msgs.size();
+
+      msg_strs.clear();
+      pubkeys.clear();
+    }
+
+    bool valid = verifyAggPartials(std::vector<PartialProduct>(1, PartialProduct(pairing_prod)), sig);
+
+    if(stats != NULL) {
+      stats->records = num_records;
+      stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      stats->records_per_sec = stats->seconds > 0 ? num_records / stats->seconds : 0;
+    }
+
+    return valid;
+  }
+
+  PubKey Bls::parseRecordPubKey(const std::string &field) {
+    // PubKey(const char*) trusts its input, so the field is checked before any coordinate is parsed
+    std::vector<std::string> components(1);
+    for(size_t i=0; i < field.size(); i++) {
+      if(field[i] == '_') {
+        components.push_back(std::string());
+      } else if(field[i] >= '0' && field[i] <= '9') {
+        components.back().push_back(field[i]);
+      } else {
+        throw std::invalid_argument("Malformed pubkey in aggregate record");
+      }
+    }
+
+    if(components.size() != 4) {
+      throw std::invalid_argument("Malformed pubkey in aggregate record");
+    }
+    for(size_t i=0; i < 4; i++) {
+      if(components[i].empty()) throw std::invalid_argument("Malformed pubkey in aggregate record");
+    }
+
+    Ec2 pk;
+    try {
+      pk = Ec2(Fp2(Fp(components[0]), Fp(components[1])), Fp2(Fp(components[2]), Fp(components[3])));
+    } catch(const std::exception &e) {
+      throw std::invalid_argument("Malformed pubkey in aggregate record");
+    }
+
+    if(!pk.isValid()) {
+      throw std::invalid_argument("Pubkey in aggregate record is not on the curve");
+    }
+
+    return PubKey(pk);
+  }
+
+  Fp12 Bls::parallelProduct(size_t n, const std::function<Fp12(size_t, size_t)> &range_product, ThreadPool *workers) {
+    const size_t num_shards = workers ? std::min(workers->size(), n) : 1;
+    if(num_shards <= 1) return range_product(0, n);
+
+    std::vector<Fp12> partials(num_shards);
+    std::vector<std::future<void> > shards_done;
+
+    // the shards reference partials and range_product, so every one of them has to finish
+    // before this frame is left, also when a shard or a submit throws
+    std::exception_ptr error;
+    try {
+      for(size_t s=0; s < num_shards; s++) {
+        const size_t begin = s * n / num_shards;
+        const size_t end = (s + 1) * n / num_shards;
+        shards_done.push_back(workers->submit([&range_product, &partials, s, begin, end]() {
+          partials[s] = range_product(begin, end);
+        }));
+      }
+    } catch(...) {
+      error = std::current_exception();
+    }
+
+    for(size_t s=0; s < shards_done.size(); s++) {
+      shards_done[s].wait();
+    }
+
+    // rethrows the first exception a worker threw
+    for(size_t s=0; s < shards_done.size(); s++) {
+      try {
+        shards_done[s].get();
+      } catch(...) {
+        if(!error) error = std::current_exception();
+      }
+    }
+    if(error) std::rethrow_exception(error);
+
+    Fp12 product = partials[0];
+    for(size_t s=1; s < num_shards; s++) {
+      product *= partials[s];
+    }
+
+    return product;
+  }
+
+  void Bls::groupByPubKey(const std::vector<const Ec2*> &pubkeys, bool group_keys, std::vector<std::vector<size_t> > &groups) {
+    groups.clear();
+
+    if(!group_keys) {
+      for(size_t i=0; i < pubkeys.size(); i++) {
+        groups.push_back(std::vector<size_t>(1, i));
+      }
+      return;
+    }
+
+    // groups keep the order in which their pubkey first appears
+    std::map<std::string, size_t> group_index;
+    for(size_t i=0; i < pubkeys.size(); i++) {
+      std::string id = pubKeyId(*pubkeys[i]);
+      std::map<std::string, size_t>::iterator it = group_index.find(id);
+
+      if(it == group_index.end()) {
+        group_index[id] = groups.size();
+        groups.push_back(std::vector<size_t>(1, i));
+      } else {
+        groups[it->second].push_back(i);
+      }
+    }
+  }
+
+  std::string Bls::pubKeyId(const Ec2 &pubkey) {
+    Ec2 normalized = pubkey;
+    normalized.normalize();
+    return normalized.p[0].toString() + "_" + normalized.p[1].toString();
+  }
+
+  Fp12 Bls::aggMillerProduct(const std::vector<msgRef> &messages, const std::vector<PubKey> &pubkeys,
+    const std::vector<std::vector<size_t> > &groups, size_t begin, size_t end, bool delay_exp) {
+    std::vector<Ec1> hashed_sums;
+    std::vector<Ec2> keys;
+
+    // hash every message of the groups in one multi-buffer pass, one prefix per group
+    std::vector<SHA256> prefixes;
+    std::vector<const SHA256*> msg_prefixes;
+    std::vector<msgRef> msgs;
+    prefixes.reserve(end - begin);
+    for(size_t g=begin; g < end; g++) {
+      const Ec2 &pubkey = pubkeys[groups[g][0]].ec2;
+      prefixes.push_back(pubkeyHashPrefix(pubkey));
+      keys.push_back(pubkey);
+      for(size_t j=0; j < groups[g].size(); j++) {
+        msg_prefixes.push_back(&prefixes.back());
+        msgs.push_back(messages[groups[g][j]]);
+      }
+    }
+
+    std::vector<Ec1> hashed_points;
+    hashMsgs(msg_prefixes, msgs, hashed_points);
+
+    // e(pk, H_1) * e(pk, H_2) = e(pk, H_1 + H_2)
+    size_t next = 0;
+    for(size_t g=begin; g < end; g++) {
+      Ec1 hashed_sum = hashed_points[next++];
+      for(size_t j=1; j < groups[g].size(); j++) {
+        hashed_sum += hashed_points[next++];
+      }
+
+      hashed_sums.push_back(hashed_sum);
+    }
+
+    if(delay_exp) return multiMillerLoop(hashed_sums, keys);
+
+    // legacy path, every group gets its own final exponentiation
+    Fp12 pairing_prod(1);
+    for(size_t g=0; g < keys.size(); g++) {
+      Fp12 pairing_g;
+      opt_atePairing(pairing_g, keys[g], hashed_sums[g]);
+      pairing_prod *= pairing_g;
+    }
+
+    return pairing_prod;
+  }
+
+  bool Bls::verifyBatch(const std::vector<sigTriple> &batch) {
+    return checkBatch(batch, NULL);
+  }
+
+  bool Bls::verifyBatch(const std::vector<sigTriple> &batch, std::vector<size_t> &bad_indices) {
+    bad_indices.clear();
+    return checkBatch(batch, &bad_indices);
+  }
+
+  bool Bls::verifyBatch(const msgArena &messages, const std::vector<PubKey> &pubkeys, const std::vector<Sig> &sigs) {
+    return checkBatch(messages, pubkeys, sigs, NULL);
+  }
+
+  bool Bls::verifyBatch(const msgArena &messages, const std::vector<PubKey> &pubkeys, const std::vector<Sig> &sigs,
+    std::vector<size_t> &bad_indices) {
+    bad_indices.clear();
+    return checkBatch(messages, pubkeys, sigs, &bad_indices);
+  }
+
+  std::vector<msgRef> Bls::toMsgRefs(const std::vector<const char*> &messages) {
+    std::vector<msgRef> refs(messages.size());
+    for(size_t i=0; i < messages.size(); i++) {
+      refs[i].data = (const uint8_t*)messages[i];
+      refs[i].len = strlen(messages[i]);
+    }
+    return refs;
+  }
+
+  std::vector<msgRef> Bls::toMsgRefs(const msgArena &messages) {
+    std::vector<msgRef> refs(messages.count);
+    for(size_t i=0; i < messages.count; i++) {
+      if(messages.offsets[i + 1] < messages.offsets[i]) {
+        throw std::invalid_argument("Message arena offsets decrease");
+      }
+      refs[i].data = messages.data + messages.offsets[i];
+      refs[i].len = messages.offsets[i + 1] - messages.offsets[i];
+    }
+    return refs;
+  }
+
+  std::vector<msgRef> Bls::arenaRefs(const msgArena &messages, size_t count) {
+    if(messages.count != count) {
+      throw std::invalid_argument("Number of messages and pubkeys differ");
+    }
+    return toMsgRefs(messages);
+  }
+
+  Ec1 Bls::hashMsgWithPubkey(const char *msg, const Ec2 &pk) {
+    return hashMsgWithPrefix(pubkeyHashPrefix(pk), msg);
+  }
+
+  Ec1 Bls::hashMsgWithPubkey(const char *msg, const PreparedPubKey &pubkey) {
+    return hashMsgWithPrefix(pubkey.hash_prefix, msg);
+  }
+
+  Ec1 Bls::hashMsgWithPubkey(const uint8_t *msg, size_t len, const Ec2 &pk) {
+    return hashMsgWithPrefix(pubkeyHashPrefix(pk), msg, len);
+  }
+
+  Ec1 Bls::hashMsgWithPubkey(const uint8_t *msg, size_t len, const PreparedPubKey &pubkey) {
+    return hashMsgWithPrefix(pubkey.hash_prefix, msg, len);
+  }
+
+  SHA256 Bls::pubkeyHashPrefix(const Ec2 &pk) {
+    SHA256 ctx = SHA256();
+    ctx.init();
+
+    // update with pubkey
+    std::string pkstr = pk.p[0].toString();
+    ctx.update( (unsigned char*)pkstr.c_str(), pkstr.length() );
+
+    return ctx;
+  }
+
+  Ec1 Bls::hashMsgWithPrefix(const SHA256 &prefix, const char *msg) {
+    return hashMsgWithPrefix(prefix, (const uint8_t*)msg, strlen(msg));
+  }
+
+  Ec1 Bls::hashMsgWithPrefix(const SHA256 &prefix, const uint8_t *msg, size_t len) {
+    unsigned char digest[SHA256::DIGEST_SIZE];
+    memset(digest,0,SHA256::DIGEST_SIZE);
+
+    // the pubkey is already absorbed, only the message is hashed
+    SHA256 ctx = prefix;
+
+    // update with msg
+    ctx.update( (const unsigned char*)msg, len );
+
+    // calculate final digest
+    ctx.final(digest);
+
+    return mapDigest(digest);
+  } 
+
+  void Bls::hashMsgs(const std::vector<const SHA256*> &prefixes, const std::vector<msgRef> &messages, std::vector<Ec1> &points) {
+    const size_t n = messages.size();
+    points.resize(n);
+    if(n == 0) return;
+
+    std::vector<const unsigned char*> msgs(n);
+    std::vector<size_t> lens(n);
+    for(size_t i=0; i < n; i++) {
+      msgs[i] = messages[i].data;
+      lens[i] = messages[i].len;
+    }
+
+    // SHA256 of several messages per compression step, then each digest onto the curve
+    std::vector<unsigned char> digests(n * SHA256::DIGEST_SIZE);
+    SHA256::hashMany(&prefixes[0], &msgs[0], &lens[0], n, &digests[0]);
+
+    for(size_t i=0; i < n; i++) {
+      points[i] = mapDigest(&digests[i * SHA256::DIGEST_SIZE]);
+    }
+  }
+
+  Ec1 Bls::mapDigest(const unsigned char *digest) {
+    if(hash_suite.load() == HASH_SVDW) return mapHashOntoCurveSvdW(digest);
+
+    // map hash onto curve
+    return mapHashOntoCurve((const uint8_t*)digest);
+  }
+
+  void Bls::genThreshKeys(const char* secret, size_t t, size_t n, std::vector<thresholdPoint>& pair_vec) {
+    // generate t-1 random numbers (TODO: do these need to be mod p?)
+
+    // TODO: add error checks
+    // vector of random coefficients
+    std::vector<mie::Vuint> r_vec(t-1);
+
+    for(uint i=0; i < t-1; i++) {
+      // generate random number in Fp
+      // !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+      // TODO: REMOVE RAND() FROM THIS CODE.
+      // THIS IS A PLACEHOLDER ONLY AND IS NOT SECURE and is ONLY A PLACEHOLDER!!!!!!!!!!!
+      r_vec[i] = mie::Vuint(random() % 100);
+    }
+
+    mie::Vuint s(secret);
+    assert(s > 0);
+
+    // calculate n points on curve (x values need not be random) 
+    for(uint i=1; i <= n; i++) {
+      mie::Vuint res = calcPolynomial(r_vec, s, i);
+      pair_vec.push_back({i, Fp(res)});
+    }
+  }
+
+  bool Bls::verifyThresholdShares(const std::vector<thresholdSigPoint>& shares,
+    const std::vector<PubKey>& share_pubkeys, const char* msg, const PubKey& pubkey) {
+    return verifyThresholdShares(shares, share_pubkeys, (const uint8_t*)msg, strlen(msg), pubkey);
+  }
+
+  bool Bls::verifyThresholdShares(const std::vector<thresholdSigPoint>& shares,
+    const std::vector<PubKey>& share_pubkeys, const uint8_t *msg, size_t len, const PubKey& pubkey) {
+    const size_t n = shares.size();
+    if(share_pubkeys.size() != n) {
+      throw std::invalid_argument("Need one public key per signature share");
+    }
+    if(n == 0) return true;
+
+    // every share signs the same point H(pk||m), so
+    // prod e(pk_i, r_i * H) / e(g2, r_i * s_i) collapses to e(sum r_i * pk_i, H) / e(g2, sum r_i * s_i)
+    std::vector<uint64_t> r;
+    genBatchScalars(n, r);
+
+    std::vector<Ec1> sig_points(n);
+    std::vector<Ec2> pubkey_points(n);
+    for(size_t i=0; i < n; i++) {
+      sig_points[i] = shares[i].y.ec1;
+      pubkey_points[i] = share_pubkeys[i].ec2;
+    }
+
+    Ec1 neg_sig_sum = multiScalarMul(&sig_points[0], &r[0], n);
+    neg_sig_sum.p[1] = -neg_sig_sum.p[1];
+
+    Ec1 g1_pair[2] = {hashMsgWithPubkey(msg, len, pubkey.ec2), neg_sig_sum};
+    Ec2 g2_pair[2] = {multiScalarMul(&pubkey_points[0], &r[0], n), g2};
+
+    return multiPairingIsOne(g1_pair, g2_pair, 2);
+  }
+
+  Sig Bls::combineThresholdSigs(const std::vector<thresholdSigPoint>& sigs, size_t t) {
+    // calculate lambdas
+    std::vector<Fp> lambdas;
+
+    // calculate each lambda
+    for(size_t j=0; j < t; j++) {
+      Fp l_j(1);
+
+      // calculate lambda
+      for(size_t m=0; m < t; m++) {
+        if(m == j) continue;
+        l_j *= (Fp(0) - sigs[m].x) / (sigs[j].x - sigs[m].x);
+      }
+
+      // push lambda into vector
+      lambdas.push_back(l_j);
+    }
+
+    // exponentiate each signature point H(pk||m)^y_i by corresponding lambda_i
+    // the lambdas are public, so the variable time multiplication is safe here
+    Ec1 sig = mulVarTime(sigs[0].y.ec1, lambdas[0].get());
+    for(size_t i=1; i < lambdas.size(); i++) {
+      sig += mulVarTime(sigs[i].y.ec1, lambdas[i].get());
+    }
+
+    return Sig(sig);
+  }
+
+  // Test to see that math checks out
+  // NOTE: this is for recovering a shamir secret to test logic for lagrange interopolation
+  // The logic is duplicated from combineThresholdSigs()
+  Fp Bls::recoverSecret(const std::vector<shamirPoint>& points, size_t t) {
+    // calculate lambdas
+    std::vector<Fp> lambdas;
+
+    // calculate each lambda
+    for(size_t j=0; j < t; j++) {
+      Fp l_j(1);
+      // calculate lambda
+      for(size_t m=0; m < t; m++) {
+        if(m == j) continue;
+        l_j *= (Fp(0) - points[m].x) / (points[j].x - points[m].x);
+      }
+
+      lambdas.push_back(l_j);
+    }
+
+    // sum l_i * y_i
+    Fp sig = points[0].y * lambdas[0];
+    for(size_t i=1; i < lambdas.size(); i++) {
+      sig += points[i].y * lambdas[i];
+    }
+
+    return sig;
+  }
+
+  /**********************************************************************
+   * Multi-pairing engine
+   **********************************************************************/
+
+  Fp12 Bls::multiMillerLoop(const Ec1 *g1_points, const Ec2 *g2_points, size_t n,
+    const std::vector<Fp6>* const *g2_lines, ThreadPool *workers) {
+    return parallelProduct(n, [&](size_t begin, size_t end) {
+      Fp12 range_prod(1);
+      for(size_t i=begin; i < end; i++) {
+        // e(0, Q) = e(P, 0) = 1
+        if(g1_points[i].isZero() || g2_points[i].isZero()) continue;
+
+        Fp12 miller_i;
+        if(g2_lines != NULL && g2_lines[i] != NULL) {
+          bn::millerLoop(miller_i, *g2_lines[i], g1_points[i]);
+        } else if(g2_points[i] == g2) {
+          // the generator's lines are computed once in the constructor
+          bn::millerLoop(miller_i, g2_coeff, g1_points[i]);
+        } else {
+          opt_atePairing(miller_i, g2_points[i], g1_points[i], false);
+        }
+        range_prod *= miller_i;
+      }
+      return range_prod;
+    }, workers);
+  }
+
+  Fp12 Bls::multiMillerLoop(const std::vector<Ec1> &g1_points, const std::vector<Ec2> &g2_points,
+    const std::vector<const std::vector<Fp6>*> *g2_lines, ThreadPool *workers) {
+    if(g1_points.size() != g2_points.size() || (g2_lines != NULL && g2_lines->size() != g1_points.size())) {
+      throw std::invalid_argument("Need one G2 point (and line set) per G1 point");
+    }
+    if(g1_points.empty()) return Fp12(1);
+
+    return multiMillerLoop(&g1_points[0], &g2_points[0], g1_points.size(),
+      g2_lines != NULL ? &(*g2_lines)[0] : NULL, workers);
+  }
+
+  Fp12 Bls::multiPairing(const Ec1 *g1_points, const Ec2 *g2_points, size_t n,
+    const std::vector<Fp6>* const *g2_lines, ThreadPool *workers) {
+    Fp12 pairing_prod = multiMillerLoop(g1_points, g2_points, n, g2_lines, workers);
+    pairing_prod.final_exp();
+    return pairing_prod;
+  }
+
+  Fp12 Bls::multiPairing(const std::vector<Ec1> &g1_points, const std::vector<Ec2> &g2_points,
+    const std::vector<const std::vector<Fp6>*> *g2_lines, ThreadPool *workers) {
+    Fp12 pairing_prod = multiMillerLoop(g1_points, g2_points, g2_lines, workers);
+    pairing_prod.final_exp();
+    return pairing_prod;
+  }
+
+  bool Bls::multiPairingIsOne(const Ec1 *g1_points, const Ec2 *g2_points, size_t n,
+    const std::vector<Fp6>* const *g2_lines, ThreadPool *workers) {
+    return multiPairing(g1_points, g2_points, n, g2_lines, workers) == Fp12(1);
+  }
+
+  bool Bls::multiPairingIsOne(const std::vector<Ec1> &g1_points, const std::vector<Ec2> &g2_points,
+    const std::vector<const std::vector<Fp6>*> *g2_lines, ThreadPool *workers) {
+    return multiPairing(g1_points, g2_points, g2_lines, workers) == Fp12(1);
+  }
+
+  /**********************************************************************
+   * Variable time operations, only for public data
+   **********************************************************************/
+
+  Ec1 Bls::mulVarTime(const Ec1 &point, const mie::Vuint &scalar) {
+    return wnafMul(point, scalarLimbs(scalar), 5);
+  }
+
+  Ec2 Bls::mulVarTime(const Ec2 &point, const mie::Vuint &scalar) {
+    return wnafMul(point, scalarLimbs(scalar), 5);
+  }
+
+  std::vector<uint64_t> Bls::scalarLimbs(const mie::Vuint &scalar) {
+    // Vuint already holds 64 bit limbs, least significant limb first
+    std::vector<uint64_t> limbs(std::max<size_t>(scalar.size(), 1), 0);
+    for(size_t i=0; i < scalar.size(); i++) {
+      limbs[i] = (uint64_t)scalar[i];
+    }
+
+    return limbs;
+  }
+
+  template<class Ec>
+  Ec Bls::wnafMul(const Ec &point, const std::vector<uint64_t> &scalar, size_t w) {
+    const int window = 1 << w;
+
+    // recode into width-w NAF digits, least significant first
+    // one spare limb absorbs the carry when a negative digit is subtracted
+    std::vector<uint64_t> k = scalar;
+    k.push_back(0);
+
+    std::vector<int> digits;
+    while(true) {
+      bool zero = true;
+      for(size_t i=0; i < k.size(); i++) {
+        if(k[i] != 0) { zero = false; break; }
+      }
+      if(zero) break;
+
+      int d = 0;
+      if(k[0] & 1) {
+        d = (int)(k[0] & (window - 1));
+        if(d >= window / 2) d -= window;
+
+        // k -= d
+        if(d > 0) {
+          k[0] -= d;
+        } else {
+          uint64_t add = -d;
+          for(size_t i=0; i < k.size() && add != 0; i++) {
+            k[i] += add;
+            add = (k[i] < add) ? 1 : 0;
+          }
+        }
+      }
+      digits.push_back(d);
+
+      // k >>= 1
+      for(size_t i=0; i < k.size(); i++) {
+        k[i] = (k[i] >> 1) | ((i + 1 < k.size()) ? (k[i + 1] << 63) : 0);
+      }
+    }
+
+    // odd multiples P, 3P, 5P, ... and their negatives
+    std::vector<Ec> table(window / 4);
+    std::vector<Ec> neg_table(window / 4);
+    Ec twice = point + point;
+    table[0] = point;
+    for(size_t i=1; i < table.size(); i++) {
+      table[i] = table[i - 1] + twice;
+    }
+    for(size_t i=0; i < table.size(); i++) {
+      neg_table[i] = table[i];
+      neg_table[i].p[1] = -neg_table[i].p[1];
+    }
+
+    Ec result;
+    result.clear();
+    for(size_t i = digits.size(); i-- > 0; ) {
+      if(!result.isZero()) result = result + result;
+
+      if(digits[i] > 0) {
+        result += table[digits[i] / 2];
+      } else if(digits[i] < 0) {
+        result += neg_table[-digits[i] / 2];
+      }
+    }
+
+    return result;
+  }
+
+  /**********************************************************************
+   * Helper Functions for Signature creation and Verification
+   **********************************************************************/
+  
+  const mie::Vuint Bls::nbits(const mie::Vuint val){
+    if(val <= 1) return 1;
+    return nbits(val / 2) + 1;
+  }
+
+  Fp Bls::prependP(const mie::Vuint val, const mie::Vuint num_digits, unsigned long pre){
+    Fp result(val % Param::p);
+    return result += Fp(pre % Param::p) * mie::power(Fp(2), num_digits);
+  }
+
+  Ec1 Bls::mapHashOntoCurve(const char* msg_digest) {
+    Ec1 hashed_msg_point;
+    unsigned long count = 0; //32-bit field
+    bool squareRootExists = false;
+    const mie::Vuint xVuintSHA256(msg_digest);
+    const mie::Vuint xVuint = xVuintSHA256 >> 1;
+    const mie::Vuint numDigits = nbits(xVuint); 
+    Fp y;
+
+    while(!squareRootExists) {
+      Fp x = prependP(xVuint, numDigits, count); //what to do if doesn't work for any count?
+      Fp x3plusb = x * x * x + CURVE_B;
+      squareRootExists = Fp::squareRoot(y, x3plusb);
+      if(xVuintSHA256 % 2 != 0) y = -y; //first bit as sign
+      if(squareRootExists){
+        const Ec1 result(x, y);
+        return result;
+      } else {
+        ++count;
+        if(count == ULONG_MAX) break;
+      }
+    }
+
+    // throw error if map fails
+    throw("This point should not have been reached \n");
+  }
+
+  Ec1 Bls::mapHashOntoCurve(const uint8_t *digest) {
+    const size_t n = SHA256::DIGEST_SIZE;
+
+    // val = digest >> 1, the low bit of the digest picks the sign of y
+    uint8_t val[SHA256::DIGEST_SIZE];
+    uint8_t carry = 0;
+    for(size_t i=0; i < n; i++) {
+      val[i] = (digest[i] >> 1) | carry;
+      carry = digest[i] << 7;
+    }
+
+    // bit length of val, 1 for val <= 1 like nbits()
+    size_t num_bits = 1;
+    for(size_t i=0; i < n; i++) {
+      if(val[i] == 0) continue;
+
+      size_t top = 0;
+      for(uint8_t b = val[i]; b != 0; b >>= 1) top++;
+      num_bits = 8 * (n - 1 - i) + top;
+      break;
+    }
+
+    // prependP(val, num_bits, count) = val + count * 2^num_bits, so each try adds 2^num_bits
+    Fp x = bytesToFp(val, n);
+    const Fp &step = pow2_table[num_bits];
+    Fp y;
+
+    for(unsigned long count=0; count < ULONG_MAX; count++) {
+      if(Fp::squareRoot(y, x * x * x + CURVE_B)) {
+        if(digest[n - 1] & 1) y = -y;
+        return Ec1(x, y);
+      }
+      x += step;
+    }
+
+    throw std::runtime_error("Could not map digest onto the curve");
+  }
+
+  Ec1 Bls::mapHashOntoCurveSvdW(const unsigned char *digest) {
+    // t_k = SHA256(k || 0 || digest) || SHA256(k || 1 || digest) mod p,
+    // 512 bits keep the bias of the reduction negligible
+    Fp t[2];
+    for(unsigned char k=0; k < 2; k++) {
+      unsigned char wide[2 * SHA256::DIGEST_SIZE];
+      for(unsigned char half=0; half < 2; half++) {
+        unsigned char tag[2] = {k, half};
+
+        SHA256 ctx = SHA256();
+        ctx.init();
+        ctx.update(tag, 2);
+        ctx.update(digest, SHA256::DIGEST_SIZE);
+        ctx.final(wide + half * SHA256::DIGEST_SIZE);
+      }
+      t[k] = bytesToFp(wide, sizeof(wide));
+    }
+
+    return svdwMap(t[0]) + svdwMap(t[1]);
+  }
+
+  Ec1 Bls::svdwMap(const Fp &t) {
+    // the formulas below are undefined for t = 0 and 1 + b + t^2 = 0. Fouque-Tibouchi set
+    // f(0) = (c1, sqrt(1 + b)), which does not exist here: 1 + b = 3 is not a square mod p.
+    // Both cases use u = 1 instead, substituted arithmetically so every t runs the same operations
+    Fp denom = t * t + Fp(1 + CURVE_B);
+    Fp exceptional((int)((t == Fp(0)) | (denom == Fp(0))));
+    Fp u = t + exceptional * (Fp(1) - t);
+    denom = u * u + Fp(1 + CURVE_B);
+
+    Fp w = svdw_sqrt_neg3 * u / denom;
+
+    // at least one of g(x_i) = x_i^3 + b is a square
+    Fp x[3];
+    x[0] = svdw_c1 - u * w;
+    x[1] = Fp(0) - Fp(1) - x[0];
+    x[2] = Fp(1) + Fp(1) / (w * w);
+
+    // every candidate is tried so the cost does not depend on which one is used
+    Fp y[3];
+    bool is_square[3];
+    for(size_t i=0; i < 3; i++) {
+      is_square[i] = Fp::squareRoot(y[i], x[i] * x[i] * x[i] + CURVE_B);
+    }
+
+    size_t i = is_square[0] ? 0 : (is_square[1] ? 1 : 2);
+    if(!is_square[i]) {
+      throw std::runtime_error("SvdW map found no point on the curve");
+    }
+
+    // the sign of y follows the parity of t
+    if((y[i].get() % 2 != 0) != (t.get() % 2 != 0)) y[i] = -y[i];
+
+    return Ec1(x[i], y[i]);
+  }
+
+  Fp Bls::bytesToFp(const unsigned char *bytes, size_t len) {
+    // Horner's rule on 16 bit digits
+    const Fp radix(1 << 16);
+    size_t i = 0;
+
+    Fp result(0);
+    if(len % 2 != 0) result = Fp(bytes[i++]);
+    for(; i < len; i += 2) {
+      result = result * radix + Fp((bytes[i] << 8) | bytes[i + 1]);
+    }
+
+    return result;
+  }
+
+  std::string Bls::tripleKey(const Ec2 &pubkey, const char* msg, const Ec1 &sig) {
+    return tripleKey(pubkey, (const uint8_t*)msg, strlen(msg), sig);
+  }
+
+  std::string Bls::tripleKey(const Ec2 &pubkey, const uint8_t *msg, size_t len, const Ec1 &sig) {
+    // normalized coordinates are unique for each point
+    Ec2 pk = pubkey;
+    Ec1 s = sig;
+    pk.normalize();
+    s.normalize();
+
+    // suite || pubkey || signature || message length || message
+    SHA256 ctx = SHA256();
+    ctx.init();
+
+    unsigned char suite = (unsigned char)hash_suite.load();
+    ctx.update(&suite, 1);
+
+    absorbFp(ctx, pk.p[0].get()[0]);
+    absorbFp(ctx, pk.p[0].get()[1]);
+    absorbFp(ctx, pk.p[1].get()[0]);
+    absorbFp(ctx, pk.p[1].get()[1]);
+    absorbFp(ctx, s.p[0]);
+    absorbFp(ctx, s.p[1]);
+
+    unsigned char len_bytes[8];
+    for(size_t i=0; i < 8; i++) len_bytes[i] = (unsigned char)((uint64_t)len >> (56 - 8 * i));
+    ctx.update(len_bytes, 8);
+
+    // SHA256::update takes an unsigned int length
+    for(size_t done = 0; done < len; ) {
+      size_t part = std::min<size_t>(len - done, 1u << 30);
+      ctx.update(msg + done, (unsigned int)part);
+      done += part;
+    }
+
+    unsigned char digest[SHA256::DIGEST_SIZE];
+    ctx.final(digest);
+
+    return std::string((const char*)digest, SHA256::DIGEST_SIZE);
+  }
+
+  void Bls::absorbFp(SHA256 &ctx, const Fp &x) {
+    // 32 byte big endian value, not the Montgomery form held in memory
+    const mie::Vuint v = x.get();
+    unsigned char bytes[32];
+    for(size_t limb=0; limb < 4; limb++) {
+      uint64_t word = limb < v.size() ? (uint64_t)v[limb] : 0;
+      for(size_t j=0; j < 8; j++) {
+        bytes[31 - 8 * limb - j] = (unsigned char)(word >> (8 * j));
+      }
+    }
+    ctx.update(bytes, 32);
+  }
+
+  void Bls::genBatchScalars(size_t n, std::vector<uint64_t>& scalars) {
+    scalars.resize(n);
+    if(n == 0) return;
+
+    if(RAND_bytes((unsigned char*)&scalars[0], n * sizeof(uint64_t)) != 1) {
+      throw std::runtime_error("Could not generate random batch scalars");
+    }
+
+    // a zero scalar would drop its triple from the check
+    for(size_t i=0; i < n; i++) {
+      while(scalars[i] == 0) {
+        if(RAND_bytes((unsigned char*)&scalars[i], sizeof(uint64_t)) != 1) {
+          throw std::runtime_error("Could not generate random batch scalars");
+        }
+      }
+    }
   }
 
-  PubKey Bls::genPubKey(const std::string& seed) {
-    return genPubKey(seed.c_str());
+  bool Bls::checkBatch(const std::vector<sigTriple>& batch, std::vector<size_t>* bad_indices) {
+    std::vector<const char*> messages;
+    std::vector<const PubKey*> pubkeys;
+    std::vector<Ec1> sig_points;
+    for(size_t i=0; i < batch.size(); i++) {
+      messages.push_back(batch[i].msg);
+      pubkeys.push_back(&batch[i].pubkey);
+      sig_points.push_back(batch[i].sig.ec1);
+    }
+
+    return checkBatch(toMsgRefs(messages), pubkeys, sig_points, bad_indices);
   }
 
-  PubKey Bls::genPubKey(mie::Vuint secret_key) {
-    // Multiply generator by pk
-    Ec2 public_key_point = g2 * secret_key;
-    return PubKey(public_key_point);
+  bool Bls::checkBatch(const msgArena &messages, const std::vector<PubKey> &pubkeys, const std::vector<Sig> &sigs,
+    std::vector<size_t>* bad_indices) {
+    if(messages.count != pubkeys.size() || messages.count != sigs.size()) {
+      throw std::invalid_argument("Number of messages, pubkeys and signatures differ");
+    }
+
+    std::vector<const PubKey*> keys;
+    std::vector<Ec1> sig_points;
+    for(size_t i=0; i < sigs.size(); i++) {
+      keys.push_back(&pubkeys[i]);
+      sig_points.push_back(sigs[i].ec1);
+    }
+
+    return checkBatch(toMsgRefs(messages), keys, sig_points, bad_indices);
   }
 
-  Sig Bls::aggregateSigs(const std::vector<Sig>& sigs) {
-    Ec1 sig_product = sigs[0].ec1;
+  bool Bls::checkBatch(const std::vector<msgRef> &messages, const std::vector<const PubKey*> &pubkeys,
+    const std::vector<Ec1> &sig_points, std::vector<size_t>* bad_indices) {
+    const size_t n = messages.size();
+    if(n == 0) return true;
+
+    // random weights keep invalid signatures from cancelling each other out
+    std::vector<uint64_t> r;
+    genBatchScalars(n, r);
+
+    // e(pk_i, r_i * H(m_i)), one Miller loop per triple
+    std::vector<SHA256> prefixes;
+    std::vector<const SHA256*> msg_prefixes;
+    prefixes.reserve(n);
+    for(size_t i=0; i < n; i++) {
+      prefixes.push_back(pubkeyHashPrefix(pubkeys[i]->ec2));
+      msg_prefixes.push_back(&prefixes.back());
+    }
 
-    for(size_t i=1; i < sigs.size(); i++) {
-      sig_product = sig_product + sigs[i].ec1;
+    std::vector<Ec1> hashed_points;
+    hashMsgs(msg_prefixes, messages, hashed_points);
+
+    std::vector<Fp12> partials(n);
+    Fp12 pairing_prod(1);
+    for(size_t i=0; i < n; i++) {
+      Ec1 weighted_point = wnafMul(hashed_points[i], std::vector<uint64_t>(1, r[i]), 4);
+      partials[i] = multiMillerLoop(&weighted_point, &pubkeys[i]->ec2, 1);
+      pairing_prod *= partials[i];
     }
 
-    return Sig(sig_product);
+    if(checkBatchProduct(pairing_prod, multiScalarMul(&sig_points[0], &r[0], n))) return true;
+    if(bad_indices == NULL) return false;
+
+    // build a product tree over the triples so that every bisection step
+    // only needs the Miller loop for its signature side
+    size_t leaves = 1;
+    while(leaves < n) leaves <<= 1;
+
+    std::vector<Fp12> prod_tree(2 * leaves, Fp12(1));
+    std::vector<Ec1> sig_tree(2 * leaves);
+    for(size_t i=0; i < 2 * leaves; i++) sig_tree[i].clear();
+
+    for(size_t i=0; i < n; i++) {
+      prod_tree[leaves + i] = partials[i];
+      sig_tree[leaves + i] = wnafMul(sig_points[i], std::vector<uint64_t>(1, r[i]), 4);
+    }
+    for(size_t node = leaves - 1; node >= 1; node--) {
+      prod_tree[node] = prod_tree[2 * node];
+      prod_tree[node] *= prod_tree[2 * node + 1];
+      sig_tree[node] = sig_tree[2 * node] + sig_tree[2 * node + 1];
+    }
+
+    // the root is the batch that just failed
+    bisectBatch([&](size_t node) {
+      return checkBatchProduct(prod_tree[node], sig_tree[node]);
+    }, 1, leaves, n, true, *bad_indices);
+    return false;
   }
 
-  bool Bls::verifySigSignAgnostic(PubKey const &pubkey, const char* msg, Sig const &sig) {
-    if(verifySig(pubkey, msg, sig)) return true;
-    // flip
-    Ec1 negEc1 = sig.ec1;
-    negEc1.p[1] = -negEc1.p[1];
-    return verifySig(pubkey, msg, negEc1);
+  bool Bls::verifySignatureSet(const SignatureSet &set) {
+    return checkSignatureSet(set, NULL);
   }
 
-  bool Bls::verifySig(PubKey const &pubkey, const char* msg, Ec1 sigEc1) {
-    Fp12 pairing_1; // e(g, H(m)^sk)
-    Fp12 pairing_2; // e(g^sk, H(m))
+  bool Bls::verifySignatureSet(const SignatureSet &set, std::vector<size_t> &bad_items) {
+    bad_items.clear();
+    return checkSignatureSet(set, &bad_items);
+  }
 
-    // ~100 us
-    Ec1 hashed_msg_point = hashMsgWithPubkey(msg, pubkey.ec2);
+  bool Bls::checkSignatureSet(const SignatureSet &set, std::vector<size_t> *bad_items) {
+    const size_t n = set.items.size();
+    if(n == 0) return true;
+
+    // one random weight per item, shared by its signature and all of its messages
+    std::vector<uint64_t> r;
+    genBatchScalars(n, r);
+
+    // r_i * H(m_ij), hashed once and kept for the bisection
+    std::vector<std::vector<Ec1> > weighted_points(n);
+    std::vector<Ec1> sig_points(n);
+    std::vector<const Ec2*> keys;
+    std::vector<const Ec1*> key_points;
+    for(size_t i=0; i < n; i++) {
+      const SignatureSet::setItem &item = set.items[i];
+      for(size_t j=0; j < item.messages.size(); j++) {
+        const std::string &msg = item.messages[j];
+        Ec1 hashed_msg_point = hashMsgWithPubkey((const uint8_t*)msg.data(), msg.size(), item.pubkeys[j].ec2);
+        weighted_points[i].push_back(wnafMul(hashed_msg_point, std::vector<uint64_t>(1, r[i]), 4));
+      }
+      // weighted_points[i] is complete, so pointers into it stay valid
+      for(size_t j=0; j < item.messages.size(); j++) {
+        keys.push_back(&item.pubkeys[j].ec2);
+        key_points.push_back(&weighted_points[i][j]);
+      }
+      sig_points[i] = item.sig;
+    }
+
+    // messages under the same pubkey share one Miller loop, across items as well
+    std::vector<std::vector<size_t> > groups;
+    groupByPubKey(keys, true, groups);
+
+    Fp12 pairing_prod = parallelProduct(groups.size(), [&](size_t begin, size_t end) {
+      std::vector<Ec1> point_sums;
+      std::vector<Ec2> group_keys;
+      for(size_t g=begin; g < end; g++) {
+        Ec1 point_sum = *key_points[groups[g][0]];
+        for(size_t j=1; j < groups[g].size(); j++) {
+          point_sum += *key_points[groups[g][j]];
+        }
+        point_sums.push_back(point_sum);
+        group_keys.push_back(*keys[groups[g][0]]);
+      }
+      return multiMillerLoop(point_sums, group_keys);
+    }, pool.get());
+
+    if(checkBatchProduct(pairing_prod, multiScalarMul(&sig_points[0], &r[0], n))) return true;
+    if(bad_items == NULL) return false;
 
-    // check pairing equality
-    // e(g, H(m)^alpha) == e(g^alpha (pubkey), H(m)) 
+    // per item product tree, the same bisection as verifyBatch
+    size_t leaves = 1;
+    while(leaves < n) leaves <<= 1;
 
-    // ~500 us
-    opt_atePairing(pairing_1, g2, sigEc1);
+    std::vector<Fp12> prod_tree(2 * leaves, Fp12(1));
+    std::vector<Ec1> sig_tree(2 * leaves);
+    for(size_t i=0; i < 2 * leaves; i++) sig_tree[i].clear();
 
-    // ~500 us
-    opt_atePairing(pairing_2, pubkey.ec2, hashed_msg_point);
+    for(size_t i=0; i < n; i++) {
+      std::vector<Ec2> item_keys;
+      for(size_t j=0; j < set.items[i].pubkeys.size(); j++) item_keys.push_back(set.items[i].pubkeys[j].ec2);
 
-    return pairing_1 == pairing_2;
+      prod_tree[leaves + i] = multiMillerLoop(weighted_points[i], item_keys, NULL, pool.get());
+      sig_tree[leaves + i] = wnafMul(sig_points[i], std::vector<uint64_t>(1, r[i]), 4);
+    }
+    for(size_t node = leaves - 1; node >= 1; node--) {
+      prod_tree[node] = prod_tree[2 * node];
+      prod_tree[node] *= prod_tree[2 * node + 1];
+      sig_tree[node] = sig_tree[2 * node] + sig_tree[2 * node + 1];
+    }
+
+    bisectBatch([&](size_t node) {
+      return checkBatchProduct(prod_tree[node], sig_tree[node]);
+    }, 1, leaves, n, true, *bad_items);
+    return false;
   }
 
-  bool Bls::verifySig(PubKey const &pubkey, const char* msg, Sig const &sig) {
-    return verifySig(pubkey, msg, sig.ec1);
+  bool Bls::verifySameSigner(const PubKey &pubkey, const std::vector<const char*> &messages, const std::vector<Sig> &sigs) {
+    return checkSameSigner(pubkey.ec2, NULL, pubkeyHashPrefix(pubkey.ec2), toMsgRefs(messages), sigs, NULL);
   }
 
-  Sig Bls::signMsg(const char *msg, const char *secret_key_str, const PubKey &pubkey) {
-    const mie::Vuint secret_key(secret_key_str);
-    return signMsg(msg, secret_key, pubkey);
+  bool Bls::verifySameSigner(const PreparedPubKey &pubkey, const std::vector<const char*> &messages,
+    const std::vector<Sig> &sigs) {
+    return checkSameSigner(pubkey.ec2, &pubkey.coeff, pubkey.hash_prefix, toMsgRefs(messages), sigs, NULL);
   }
 
-  Sig Bls::signMsg(const char *msg, const mie::Vuint secret_key, const PubKey &pubkey) {
-    Ec1 hashed_msg_point = hashMsgWithPubkey(msg, pubkey.ec2);
-    return Sig(hashed_msg_point * secret_key);
+  bool Bls::verifySameSigner(const PubKey &pubkey, const std::vector<const char*> &messages, const std::vector<Sig> &sigs,
+    std::vector<size_t> &bad_indices) {
+    bad_indices.clear();
+    return checkSameSigner(pubkey.ec2, NULL, pubkeyHashPrefix(pubkey.ec2), toMsgRefs(messages), sigs, &bad_indices);
   }
 
-  Sig Bls::signMsg(std::string& msg, const mie::Vuint secret_key, const PubKey &pubkey) {
-    return signMsg(msg.c_str(), secret_key, pubkey);
+  bool Bls::verifySameSigner(const PubKey &pubkey, const msgArena &messages, const std::vector<Sig> &sigs) {
+    return checkSameSigner(pubkey.ec2, NULL, pubkeyHashPrefix(pubkey.ec2), toMsgRefs(messages), sigs, NULL);
   }
 
-  bool Bls::verifyAggSig(const std::vector<const char*> &messages, const std::vector<PubKey> &pubkeys, const Sig &sig, bool delay_exp) {
-    // check that same number of messages and pubkeys
-    if(messages.size() != pubkeys.size()) {
-      cerr << "SIZES NOT EQUAL" << endl;
-      return false;
+  bool Bls::verifySameSigner(const PreparedPubKey &pubkey, const msgArena &messages, const std::vector<Sig> &sigs) {
+    return checkSameSigner(pubkey.ec2, &pubkey.coeff, pubkey.hash_prefix, toMsgRefs(messages), sigs, NULL);
+  }
+
+  bool Bls::verifySameSigner(const PubKey &pubkey, const msgArena &messages, const std::vector<Sig> &sigs,
+    std::vector<size_t> &bad_indices) {
+    bad_indices.clear();
+    return checkSameSigner(pubkey.ec2, NULL, pubkeyHashPrefix(pubkey.ec2), toMsgRefs(messages), sigs, &bad_indices);
+  }
+
+  bool Bls::checkSameSigner(const Ec2 &pubkey, const std::vector<Fp6> *lines, const SHA256 &hash_prefix,
+    const std::vector<msgRef> &messages,
+    const std::vector<Sig> &sigs, std::vector<size_t> *bad_indices) {
+    const size_t n = messages.size();
+    if(sigs.size() != n) {
+      throw std::invalid_argument("Need one signature per message");
     }
+    if(n == 0) return true;
 
-    // calculate initial pairing
-    Fp12 pairing_prod;
-    Ec1 hashed_msg_point = hashMsgWithPubkey(messages[0], pubkeys[0].ec2);
-    opt_atePairing(pairing_prod, pubkeys[0].ec2, hashed_msg_point, !delay_exp);
+    std::vector<uint64_t> r;
+    genBatchScalars(n, r);
 
-    // Set for checking that all messages are unique
-    std::vector<Ec1> hashed_msgs;
-    hashed_msgs.push_back(hashed_msg_point);
+    std::vector<Ec1> hashed_points;
+    hashMsgs(std::vector<const SHA256*>(n, &hash_prefix), messages, hashed_points);
 
-    for(size_t i=1; i < messages.size(); i++) {
-      Fp12 pairing_i;
-      Ec1 hashed_msg_point = hashMsgWithPubkey(messages[i], pubkeys[i].ec2);
-      Ec2 pubkey = pubkeys[i].ec2;
-      hashed_msgs.push_back(hashed_msg_point);
-      opt_atePairing(pairing_i, pubkey, hashed_msg_point, !delay_exp);
-      pairing_prod *= pairing_i;
+    std::vector<Ec1> sig_points(n);
+    for(size_t i=0; i < n; i++) {
+      sig_points[i] = sigs[i].ec1;
     }
 
-    if(delay_exp) {
-      pairing_prod.final_exp();
+    // e(pubkey, hash_sum) * e(g, -sig_sum) == 1
+    Ec2 g2_pair[2] = {pubkey, g2};
+    const std::vector<Fp6>* g2_lines[2] = {lines, &g2_coeff};
+    auto sums_valid = [&](const Ec1 &hash_sum, const Ec1 &sig_sum) {
+      Ec1 neg_sig_sum = sig_sum;
+      neg_sig_sum.p[1] = -neg_sig_sum.p[1];
+      Ec1 g1_pair[2] = {hash_sum, neg_sig_sum};
+      return multiPairingIsOne(g1_pair, g2_pair, 2, g2_lines);
+    };
+
+    if(sums_valid(multiScalarMul(&hashed_points[0], &r[0], n), multiScalarMul(&sig_points[0], &r[0], n))) return true;
+    if(bad_indices == NULL) return false;
+
+    // every node of the bisection only needs the two sums over its leaves
+    size_t leaves = 1;
+    while(leaves < n) leaves <<= 1;
+
+    std::vector<Ec1> hash_tree(2 * leaves);
+    std::vector<Ec1> sig_tree(2 * leaves);
+    for(size_t i=0; i < 2 * leaves; i++) {
+      hash_tree[i].clear();
+      sig_tree[i].clear();
     }
 
-    // calculate pairing with agg signature
-    Fp12 pairing_agg;
-    opt_atePairing(pairing_agg, g2, sig.ec1);
+    for(size_t i=0; i < n; i++) {
+      hash_tree[leaves + i] = wnafMul(hashed_points[i], std::vector<uint64_t>(1, r[i]), 4);
+      sig_tree[leaves + i] = wnafMul(sig_points[i], std::vector<uint64_t>(1, r[i]), 4);
+    }
+    for(size_t node = leaves - 1; node >= 1; node--) {
+      hash_tree[node] = hash_tree[2 * node] + hash_tree[2 * node + 1];
+      sig_tree[node] = sig_tree[2 * node] + sig_tree[2 * node + 1];
+    }
 
-    return pairing_agg == pairing_prod;
+    bisectBatch([&](size_t node) {
+      return sums_valid(hash_tree[node], sig_tree[node]);
+    }, 1, leaves, n, true, *bad_indices);
+    return false;
   }
 
-  Ec1 Bls::hashMsgWithPubkey(const char *msg, const Ec2 &pk) {
-    unsigned char digest[SHA256::DIGEST_SIZE];
-    memset(digest,0,SHA256::DIGEST_SIZE);
+  bool Bls::checkBatchProduct(const Fp12& miller_prod, Ec1 sig_sum) {
+    sig_sum.p[1] = -sig_sum.p[1];
 
-    SHA256 ctx = SHA256();
-    ctx.init();
+    Fp12 pairing_sig = multiMillerLoop(&sig_sum, &g2, 1);
+    pairing_sig *= miller_prod;
 
-    // update with pubkey
-    std::string pkstr = pk.p[0].toString();
-    ctx.update( (unsigned char*)pkstr.c_str(), pkstr.length() );
+    pairing_sig.final_exp();
 
-    // update with msg
-    ctx.update( (unsigned char*)msg, strlen(msg) );
+    return pairing_sig == Fp12(1);
+  }
 
-    // calculate final digest
-    ctx.final(digest);
+  void Bls::bisectBatch(const std::function<bool(size_t)> &node_valid, size_t node,
+    size_t leaves, size_t n, bool known_bad, std::vector<size_t>& bad_indices) {
+    // range of leaves covered by node
+    size_t depth = 0;
+    while(((size_t)2 << depth) <= node) depth++;
+    const size_t span = leaves >> depth;
+    const size_t first = (node - ((size_t)1 << depth)) * span;
 
-    char buf[2*SHA256::DIGEST_SIZE+3];
-    // add null terminator to end
-    buf[2*SHA256::DIGEST_SIZE] = 0;
+    // padding only
+    if(first >= n) return;
 
-    // prepend with 0x
-    buf[0] = '0';
-    buf[1] = 'x';
+    if(!known_bad && node_valid(node)) return;
 
-    // fill buf with digest
-    for (int i = 0; i < SHA256::DIGEST_SIZE; i++) {
-      sprintf(buf+(i*2)+2, "%02x", digest[i]);
+    if(span == 1) {
+      bad_indices.push_back(first);
+      return;
     }
 
-    // map hash onto curve
-    return mapHashOntoCurve(buf);
-  } 
+    // products multiply, so if one half passes the other half must fail
+    if(first + span / 2 >= n) {
+      bisectBatch(node_valid, 2 * node, leaves, n, true, bad_indices);
+    } else if(node_valid(2 * node)) {
+      bisectBatch(node_valid, 2 * node + 1, leaves, n, true, bad_indices);
+    } else {
+      bisectBatch(node_valid, 2 * node, leaves, n, true, bad_indices);
+      bisectBatch(node_valid, 2 * node + 1, leaves, n, false, bad_indices);
+    }
+  }
 
-  void Bls::genThreshKeys(const char* secret, size_t t, size_t n, std::vector<thresholdPoint>& pair_vec) {
-    // generate t-1 random numbers (TODO: do these need to be mod p?)
+  template<class Ec>
+  Ec Bls::multiScalarMul(const Ec* points, const uint64_t* scalars, size_t n) {
+    // window size in bits, grows with the number of points
+    size_t c = 2;
+    while(c < 16 && ((size_t)1 << (c + 2)) < n) c++;
 
-    // TODO: add error checks
-    // vector of random coefficients
-    std::vector<mie::Vuint> r_vec(t-1);
+    const size_t num_windows = (64 + c - 1) / c;
+    const size_t num_buckets = ((size_t)1 << c) - 1;
 
-    for(uint i=0; i < t-1; i++) {
-      // generate random number in Fp
-      // !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
-      // TODO: REMOVE RAND() FROM THIS CODE.
-      // THIS IS A PLACEHOLDER ONLY AND IS NOT SECURE and is ONLY A PLACEHOLDER!!!!!!!!!!!
-      r_vec[i] = mie::Vuint(random() % 100);
+    Ec result;
+    result.clear();
+    std::vector<Ec> buckets(num_buckets);
+
+    for(size_t w = num_windows; w-- > 0; ) {
+      // shift the running result up by one window
+      if(!result.isZero()) {
+        for(size_t j=0; j < c; j++) result = result + result;
+      }
+
+      for(size_t b=0; b < num_buckets; b++) buckets[b].clear();
+
+      // drop each point into the bucket of its digit in this window
+      for(size_t i=0; i < n; i++) {
+        size_t digit = (scalars[i] >> (w * c)) & num_buckets;
+        if(digit != 0) buckets[digit - 1] += points[i];
+      }
+
+      // sum b * bucket_b using running sums
+      Ec running;
+      Ec window_sum;
+      running.clear();
+      window_sum.clear();
+      for(size_t b = num_buckets; b-- > 0; ) {
+        running += buckets[b];
+        window_sum += running;
+      }
+
+      result += window_sum;
     }
 
-    mie::Vuint s(secret);
-    assert(s > 0);
+    return result;
+  }
 
-    // calculate n points on curve (x values need not be random) 
-    for(uint i=1; i <= n; i++) {
-      mie::Vuint res = calcPolynomial(r_vec, s, i);
-      pair_vec.push_back({i, Fp(res)});
+  // y = secret + r_0*x + r_1 * x^2 + r_2 * x^3 ... r_n * x^n
+  mie::Vuint Bls::calcPolynomial(std::vector<mie::Vuint>& r_vals, mie::Vuint secret, int x) {
+    Fp y(secret);
+    for(size_t i=1; i <= r_vals.size(); i++) {
+      Fp r_p = Fp(r_vals[i-1]);
+      Fp x_p = Fp(x);
+      y += r_p * mie::power(x_p, i);
     }
+    return y.get();
   }
 
-  Sig Bls::combineThresholdSigs(const std::vector<thresholdSigPoint>& sigs, size_t t) {
-    // calculate lambdas
-    std::vector<Fp> lambdas;
+  /*******************************************
+   * Incremental Aggregate Verification
+   *******************************************/
 
-    // calculate each lambda
-    for(size_t j=0; j < t; j++) {
-      Fp l_j(1);
+  AggVerifier::AggVerifier(Bls &bls) : bls(bls), miller_prod(1), count(0) {
+    agg_sig.clear();
+  }
 
-      // calculate lambda
-      for(size_t m=0; m < t; m++) {
-        if(m == j) continue;
-        l_j *= (Fp(0) - sigs[m].x) / (sigs[j].x - sigs[m].x);
-      }
+  void AggVerifier::add(const PubKey &pubkey, const char* msg, const Sig &sig) {
+    add(pubkey, (const uint8_t*)msg, strlen(msg), sig);
+  }
 
-      // push lambda into vector
-      lambdas.push_back(l_j);
-    }
+  void AggVerifier::add(const PubKey &pubkey, const uint8_t *msg, size_t len, const Sig &sig) {
+    Ec1 hashed_msg_point = bls.hashMsgWithPubkey(msg, len, pubkey.ec2);
 
-    // exponentiate each signature point H(pk||m)^y_i by corresponding lambda_i
-    Ec1 sig = sigs[0].y.ec1 * lambdas[0].get();
-    for(size_t i=1; i < lambdas.size(); i++) {
-      sig += sigs[i].y.ec1 * lambdas[i].get();
-    }
+    miller_prod *= bls.multiMillerLoop(&hashed_msg_point, &pubkey.ec2, 1);
+    agg_sig += sig.ec1;
+    count++;
+  }
 
-    return Sig(sig);
+  void AggVerifier::remove(const PubKey &pubkey, const char* msg, const Sig &sig) {
+    remove(pubkey, (const uint8_t*)msg, strlen(msg), sig);
   }
 
-  // Test to see that math checks out
-  // NOTE: this is for recovering a shamir secret to test logic for lagrange interopolation
-  // The logic is duplicated from combineThresholdSigs()
-  Fp Bls::recoverSecret(const std::vector<shamirPoint>& points, size_t t) {
-    // calculate lambdas
-    std::vector<Fp> lambdas;
+  void AggVerifier::remove(const PubKey &pubkey, const uint8_t *msg, size_t len, const Sig &sig) {
+    // e(pk, H(m)) * e(pk, -H(m)) == 1 after the final exponentiation
+    Ec1 neg_hashed_msg_point = bls.hashMsgWithPubkey(msg, len, pubkey.ec2);
+    neg_hashed_msg_point.p[1] = -neg_hashed_msg_point.p[1];
 
-    // calculate each lambda
-    for(size_t j=0; j < t; j++) {
-      Fp l_j(1);
-      // calculate lambda
-      for(size_t m=0; m < t; m++) {
-        if(m == j) continue;
-        l_j *= (Fp(0) - points[m].x) / (points[j].x - points[m].x);
-      }
+    miller_prod *= bls.multiMillerLoop(&neg_hashed_msg_point, &pubkey.ec2, 1);
+    agg_sig = agg_sig - sig.ec1;
+    if(count > 0) count--;
+  }
 
-      lambdas.push_back(l_j);
-    }
+  bool AggVerifier::check() {
+    Fp12 pairing_prod = miller_prod;
 
-    // sum l_i * y_i
-    Fp sig = points[0].y * lambdas[0];
-    for(size_t i=1; i < lambdas.size(); i++) {
-      sig += points[i].y * lambdas[i];
-    }
+    // e(g, -agg_sig), an empty aggregate contributes 1
+    Ec1 neg_sig = agg_sig;
+    neg_sig.p[1] = -neg_sig.p[1];
+    pairing_prod *= bls.multiMillerLoop(&neg_sig, &bls.g2, 1);
 
-    return sig;
+    pairing_prod.final_exp();
+
+    return pairing_prod == Fp12(1);
   }
 
-  /**********************************************************************
-   * Helper Functions for Signature creation and Verification
-   **********************************************************************/
-  
-  const mie::Vuint Bls::nbits(const mie::Vuint val){
-    if(val <= 1) return 1;
-    return nbits(val / 2) + 1;
+  Sig AggVerifier::aggregateSig() const {
+    return Sig(agg_sig);
   }
 
-  Fp Bls::prependP(const mie::Vuint val, const mie::Vuint num_digits, unsigned long pre){
-    Fp result(val % Param::p);
-    return result += Fp(pre % Param::p) * mie::power(Fp(2), num_digits);
+  size_t AggVerifier::size() const {
+    return count;
   }
 
-  Ec1 Bls::mapHashOntoCurve(const char* msg_digest) {
-    Ec1 hashed_msg_point;
-    unsigned long count = 0; //32-bit field
-    bool squareRootExists = false;
-    const mie::Vuint xVuintSHA256(msg_digest);
-    const mie::Vuint xVuint = xVuintSHA256 >> 1;
-    const mie::Vuint numDigits = nbits(xVuint); 
-    Fp y;
+  /*******************************************
+   * Mixed Signature Sets
+   *******************************************/
 
-    while(!squareRootExists) {
-      Fp x = prependP(xVuint, numDigits, count); //what to do if doesn't work for any count?
-      Fp x3plusb = x * x * x + CURVE_B;
-      squareRootExists = Fp::squareRoot(y, x3plusb);
-      if(xVuintSHA256 % 2 != 0) y = -y; //first bit as sign
-      if(squareRootExists){
-        const Ec1 result(x, y);
-        return result;
-      } else {
-        ++count;
-        if(count == ULONG_MAX) break;
-      }
+  MessageBuffer::MessageBuffer() : offsets(1, 0) {}
+
+  void MessageBuffer::add(const uint8_t *msg, size_t len) {
+    data.append((const char*)msg, len);
+    offsets.push_back(data.size());
+  }
+
+  void MessageBuffer::add(const std::string &msg) {
+    add((const uint8_t*)msg.data(), msg.size());
+  }
+
+  msgRef MessageBuffer::operator[](size_t i) const {
+    msgRef ref;
+    ref.data = (const uint8_t*)data.data() + offsets.at(i);
+    ref.len = offsets.at(i + 1) - offsets[i];
+    return ref;
+  }
+
+  msgArena MessageBuffer::arena() const {
+    msgArena messages;
+    messages.data = (const uint8_t*)data.data();
+    messages.offsets = &offsets[0];
+    messages.count = size();
+    return messages;
+  }
+
+  size_t MessageBuffer::size() const {
+    return offsets.size() - 1;
+  }
+
+  void MessageBuffer::clear() {
+    data.clear();
+    offsets.assign(1, 0);
+  }
+
+  size_t SignatureSet::addSingle(const PubKey &pubkey, const char* msg, const Sig &sig) {
+    return addSingle(pubkey, (const uint8_t*)msg, strlen(msg), sig);
+  }
+
+  size_t SignatureSet::addSingle(const PubKey &pubkey, const uint8_t *msg, size_t len, const Sig &sig) {
+    setItem item;
+    item.kind = SINGLE;
+    item.messages.push_back(std::string((const char*)msg, len));
+    item.pubkeys.push_back(pubkey);
+    item.sig = sig.ec1;
+
+    items.push_back(item);
+    return items.size() - 1;
+  }
+
+  size_t SignatureSet::addAggregate(const std::vector<const char*> &messages, const std::vector<PubKey> &pubkeys,
+    const Sig &sig) {
+    if(messages.size() != pubkeys.size()) {
+      throw std::invalid_argument("Number of messages and pubkeys differ");
     }
 
-    // throw error if map fails
-    throw("This point should not have been reached \n");
+    setItem item;
+    item.kind = AGGREGATE;
+    item.messages.assign(messages.begin(), messages.end());
+    item.pubkeys = pubkeys;
+    item.sig = sig.ec1;
+
+    items.push_back(item);
+    return items.size() - 1;
   }
 
-  // y = secret + r_0*x + r_1 * x^2 + r_2 * x^3 ... r_n * x^n
-  mie::Vuint Bls::calcPolynomial(std::vector<mie::Vuint>& r_vals, mie::Vuint secret, int x) {
-    Fp y(secret);
-    for(size_t i=1; i <= r_vals.size(); i++) {
-      Fp r_p = Fp(r_vals[i-1]);
-      Fp x_p = Fp(x);
-      y += r_p * mie::power(x_p, i);
+  size_t SignatureSet::addAggregate(const msgArena &messages, const std::vector<PubKey> &pubkeys, const Sig &sig) {
+    if(messages.count != pubkeys.size()) {
+      throw std::invalid_argument("Number of messages and pubkeys differ");
     }
-    return y.get();
+
+    setItem item;
+    item.kind = AGGREGATE;
+    std::vector<msgRef> refs = Bls::toMsgRefs(messages);
+    for(size_t i=0; i < refs.size(); i++) {
+      item.messages.push_back(std::string((const char*)refs[i].data, refs[i].len));
+    }
+    item.pubkeys = pubkeys;
+    item.sig = sig.ec1;
+
+    items.push_back(item);
+    return items.size() - 1;
+  }
+
+  size_t SignatureSet::addThreshold(const PubKey &group_pubkey, const char* msg, const Sig &sig) {
+    return addThreshold(group_pubkey, (const uint8_t*)msg, strlen(msg), sig);
+  }
+
+  size_t SignatureSet::addThreshold(const PubKey &group_pubkey, const uint8_t *msg, size_t len, const Sig &sig) {
+    // a combined threshold signature is an ordinary signature under the group key
+    size_t index = addSingle(group_pubkey, msg, len, sig);
+    items[index].kind = THRESHOLD;
+    return index;
+  }
+
+  SignatureSet::itemKind SignatureSet::kind(size_t item) const {
+    return items.at(item).kind;
+  }
+
+  size_t SignatureSet::size() const {
+    return items.size();
+  }
+
+  void SignatureSet::clear() {
+    items.clear();
   }
 
   /*******************************************
@@ -352,6 +2048,7 @@ namespace bls {
       components.push_back(string(token));
       token = std::strtok(NULL, "_");
     }
+    free(newStr);
 
     assert(components.size() == 4);
     
@@ -371,7 +2068,7 @@ namespace bls {
     ec2 = pk;
   }
 
-  string PubKey::toString() {
+  string PubKey::toString() const {
     Fp2 x = ec2.p[0];
     Fp2 y = ec2.p[1];
     Fp2 z = ec2.p[2];
@@ -383,6 +2080,73 @@ namespace bls {
   Ec2 PubKey::toEc2() {
     return ec2;
   }
+
+  PartialProduct::PartialProduct(Fp12 fp12) : fp12(fp12) {}
+
+  PartialProduct::PartialProduct(const std::string &serializedPartial) {
+    if(serializedPartial.size() != SERIALIZED_SIZE) {
+      throw std::invalid_argument("Serialized partial product has the wrong size");
+    }
+
+    Fp *coeffs[12];
+    coefficients(fp12, coeffs);
+
+    static const char hex_digits[] = "0123456789abcdef";
+    for(size_t i=0; i < 12; i++) {
+      std::string hex = "0x";
+      for(size_t j=0; j < 32; j++) {
+        unsigned char byte = serializedPartial[i * 32 + j];
+        hex += hex_digits[byte >> 4];
+        hex += hex_digits[byte & 0xf];
+      }
+
+      mie::Vuint value(hex);
+      if(value >= Param::p) {
+        throw std::invalid_argument("Serialized partial product coefficient out of range");
+      }
+      *coeffs[i] = Fp(value);
+    }
+  }
+
+  std::string PartialProduct::serialize() const {
+    Fp12 f = fp12;
+    Fp *coeffs[12];
+    coefficients(f, coeffs);
+
+    std::string out(SERIALIZED_SIZE, '\0');
+    for(size_t i=0; i < 12; i++) {
+      std::string hex = coeffs[i]->get().toString(16);
+      if(hex.compare(0, 2, "0x") == 0) hex = hex.substr(2);
+
+      // coefficients are below p < 2^256, left pad to 32 bytes
+      hex = std::string(64 - hex.size(), '0') + hex;
+      for(size_t j=0; j < 32; j++) {
+        out[i * 32 + j] = (char)strtoul(hex.substr(2 * j, 2).c_str(), NULL, 16);
+      }
+    }
+
+    return out;
+  }
+
+  void PartialProduct::coefficients(Fp12 &f, Fp *coeffs[12]) {
+    Fp6 *fp6s[2] = {&f.a_, &f.b_};
+    for(size_t i=0; i < 2; i++) {
+      Fp2 *fp2s[3] = {&fp6s[i]->a_, &fp6s[i]->b_, &fp6s[i]->c_};
+      for(size_t j=0; j < 3; j++) {
+        coeffs[i * 6 + j * 2] = &fp2s[j]->a_;
+        coeffs[i * 6 + j * 2 + 1] = &fp2s[j]->b_;
+      }
+    }
+  }
+
+  PreparedPubKey::PreparedPubKey(const PubKey &pubkey) {
+    bn::precomputeG2(coeff, ec2, pubkey.ec2);
+    hash_prefix = Bls::pubkeyHashPrefix(ec2);
+  }
+
+  size_t PreparedPubKey::memoryFootprint() const {
+    return sizeof(PreparedPubKey) + coeff.capacity() * sizeof(Fp6);
+  }
 }
 
 #endif
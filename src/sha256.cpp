@@ -37,8 +37,16 @@
 
 #include <cstring>
 #include <fstream>
+#include <vector>
+#include <stdint.h>
 #include "sha256.h"
 
+// lane parallel engines need x86 intrinsics and per function target attributes
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SHA256_MULTI_BUFFER 1
+#include <immintrin.h>
+#endif
+
 const unsigned int SHA256::sha256_k[64] = //UL = uint32
             {0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
              0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
@@ -151,6 +159,241 @@ void SHA256::final(unsigned char *digest)
     }
 }
 
+namespace {
+/*
+ * Blocks of one hash in a multi-buffer lane: an optional first block joining the bytes
+ * buffered in the state with the start of the message, the full blocks of the message
+ * read in place, then one or two padded tail blocks
+ */
+struct sha256Job {
+    uint32_t h[8];
+    bool has_head;
+    unsigned char head[64];
+    const unsigned char *mid;
+    size_t mid_nb;
+    unsigned char tail[128];
+    size_t nb;
+
+    const unsigned char *block(size_t k) const
+    {
+        if (has_head) {
+            if (k == 0) return head;
+            k--;
+        }
+        if (k < mid_nb) return mid + (k << 6);
+        return tail + ((k - mid_nb) << 6);
+    }
+};
+
+typedef void (*laneCompress)(uint32_t *state, const unsigned char *const *blocks, const unsigned int *k);
+
+inline uint32_t loadBE32(const unsigned char *p)
+{
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | (uint32_t) p[3];
+}
+
+inline void storeDigest(const uint32_t *h, size_t stride, unsigned char *digest)
+{
+    for (int j = 0; j < 8; j++) {
+        uint32_t x = h[j * stride];
+        digest[4 * j + 0] = (unsigned char) (x >> 24);
+        digest[4 * j + 1] = (unsigned char) (x >> 16);
+        digest[4 * j + 2] = (unsigned char) (x >> 8);
+        digest[4 * j + 3] = (unsigned char) x;
+    }
+}
+
+#ifdef SHA256_MULTI_BUFFER
+/*
+ * One compression step on 8 (AVX2) or 16 (AVX-512) independent blocks
+ * state holds word j of lane i at state[j * lanes + i]
+ */
+#define SHA256_MB_COMPRESS(NAME, TARGET, LANES, VEC, LOAD, STORE, SET1, ADD, XOR, AND, ANDNOT, OR, SRLI, ROTR) \
+__attribute__((target(TARGET)))                                                       \
+void NAME(uint32_t *state, const unsigned char *const *blocks, const unsigned int *k) \
+{                                                                                     \
+    VEC w[64];                                                                        \
+    uint32_t words[LANES];                                                            \
+    for (int j = 0; j < 16; j++) {                                                    \
+        for (int i = 0; i < LANES; i++) words[i] = loadBE32(blocks[i] + (j << 2));    \
+        w[j] = LOAD((const VEC*) words);                                              \
+    }                                                                                 \
+    for (int j = 16; j < 64; j++) {                                                   \
+        VEC s0 = XOR(XOR(ROTR(w[j - 15], 7), ROTR(w[j - 15], 18)), SRLI(w[j - 15], 3)); \
+        VEC s1 = XOR(XOR(ROTR(w[j - 2], 17), ROTR(w[j - 2], 19)), SRLI(w[j - 2], 10)); \
+        w[j] = ADD(ADD(s1, w[j - 7]), ADD(s0, w[j - 16]));                            \
+    }                                                                                 \
+    VEC wv[8];                                                                        \
+    for (int j = 0; j < 8; j++) wv[j] = LOAD((const VEC*) (state + j * LANES));       \
+    for (int j = 0; j < 64; j++) {                                                    \
+        VEC f2 = XOR(XOR(ROTR(wv[4], 6), ROTR(wv[4], 11)), ROTR(wv[4], 25));          \
+        VEC ch = XOR(AND(wv[4], wv[5]), ANDNOT(wv[4], wv[6]));                        \
+        VEC t1 = ADD(ADD(ADD(wv[7], f2), ADD(ch, SET1((int) k[j]))), w[j]);           \
+        VEC f1 = XOR(XOR(ROTR(wv[0], 2), ROTR(wv[0], 13)), ROTR(wv[0], 22));          \
+        VEC maj = OR(AND(wv[0], wv[1]), AND(wv[2], OR(wv[0], wv[1])));                \
+        VEC t2 = ADD(f1, maj);                                                        \
+        wv[7] = wv[6];                                                                \
+        wv[6] = wv[5];                                                                \
+        wv[5] = wv[4];                                                                \
+        wv[4] = ADD(wv[3], t1);                                                       \
+        wv[3] = wv[2];                                                                \
+        wv[2] = wv[1];                                                                \
+        wv[1] = wv[0];                                                                \
+        wv[0] = ADD(t1, t2);                                                          \
+    }                                                                                 \
+    for (int j = 0; j < 8; j++) {                                                     \
+        VEC h = LOAD((const VEC*) (state + j * LANES));                               \
+        STORE((VEC*) (state + j * LANES), ADD(h, wv[j]));                             \
+    }                                                                                 \
+}
+
+#define SHA256_AVX2_ROTR(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+SHA256_MB_COMPRESS(compressAVX2, "avx2", 8, __m256i, _mm256_loadu_si256, _mm256_storeu_si256,
+    _mm256_set1_epi32, _mm256_add_epi32, _mm256_xor_si256, _mm256_and_si256, _mm256_andnot_si256,
+    _mm256_or_si256, _mm256_srli_epi32, SHA256_AVX2_ROTR)
+
+SHA256_MB_COMPRESS(compressAVX512, "avx512f", 16, __m512i, _mm512_loadu_si512, _mm512_storeu_si512,
+    _mm512_set1_epi32, _mm512_add_epi32, _mm512_xor_si512, _mm512_and_si512, _mm512_andnot_si512,
+    _mm512_or_si512, _mm512_srli_epi32, _mm512_ror_epi32)
+#endif
+
+/*
+ * Run the jobs through a lanes wide engine, a lane takes the next job as soon as
+ * its current one is finalized, so hashes of different lengths share the lanes
+ */
+void runLanes(const std::vector<sha256Job> &jobs, unsigned char *digests, size_t lanes,
+    laneCompress compress, const unsigned int *k)
+{
+    static const size_t IDLE = (size_t) -1;
+    static const unsigned char idle_block[64] = {0};
+
+    // zeroed so lanes that never get a job compress defined words
+    uint32_t state[8 * 16] = {0};
+    const unsigned char *blocks[16];
+    size_t lane_job[16];
+    size_t lane_pos[16];
+    size_t next = 0;
+    size_t active = 0;
+
+    for (size_t i = 0; i < lanes; i++) {
+        lane_job[i] = IDLE;
+        if (next < jobs.size()) {
+            lane_job[i] = next++;
+            lane_pos[i] = 0;
+            for (int j = 0; j < 8; j++) state[j * lanes + i] = jobs[lane_job[i]].h[j];
+            active++;
+        }
+    }
+
+    while (active > 0) {
+        // idle lanes compress a dummy block, their state is never read
+        for (size_t i = 0; i < lanes; i++) {
+            blocks[i] = lane_job[i] == IDLE ? idle_block : jobs[lane_job[i]].block(lane_pos[i]);
+        }
+        compress(state, blocks, k);
+
+        for (size_t i = 0; i < lanes; i++) {
+            if (lane_job[i] == IDLE || ++lane_pos[i] < jobs[lane_job[i]].nb) continue;
+
+            storeDigest(state + i, lanes, digests + lane_job[i] * SHA256::DIGEST_SIZE);
+            if (next < jobs.size()) {
+                lane_job[i] = next++;
+                lane_pos[i] = 0;
+                for (int j = 0; j < 8; j++) state[j * lanes + i] = jobs[lane_job[i]].h[j];
+            } else {
+                lane_job[i] = IDLE;
+                active--;
+            }
+        }
+    }
+}
+
+unsigned int cpuLanes()
+{
+#ifdef SHA256_MULTI_BUFFER
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return 16;
+    if (__builtin_cpu_supports("avx2")) return 8;
+#endif
+    return 1;
+}
+}
+
+unsigned int SHA256::lanes()
+{
+    static const unsigned int cpu_lanes = cpuLanes();
+    return cpu_lanes;
+}
+
+unsigned int SHA256::hashMany(const SHA256 *const *states, const unsigned char *const *messages,
+    const size_t *lens, size_t n, unsigned char *digests, size_t max_lanes)
+{
+    std::vector<sha256Job> jobs(n);
+    for (size_t i = 0; i < n; i++) {
+        const SHA256 &st = *states[i];
+        const unsigned char *msg = messages[i];
+        size_t len = lens[i];
+        sha256Job &job = jobs[i];
+
+        memcpy(job.h, st.m_h, sizeof(job.h));
+        uint64_t bit_len = ((uint64_t) st.m_tot_len + st.m_len + len) << 3;
+
+        // bytes left over after the head and the full blocks
+        const unsigned char *rest;
+        size_t rest_len;
+        job.has_head = st.m_len + len >= SHA224_256_BLOCK_SIZE;
+        if (job.has_head) {
+            size_t fill = SHA224_256_BLOCK_SIZE - st.m_len;
+            memcpy(job.head, st.m_block, st.m_len);
+            memcpy(job.head + st.m_len, msg, fill);
+            job.mid = msg + fill;
+            job.mid_nb = (len - fill) / SHA224_256_BLOCK_SIZE;
+            rest = job.mid + (job.mid_nb << 6);
+            rest_len = (len - fill) % SHA224_256_BLOCK_SIZE;
+            memset(job.tail, 0, sizeof(job.tail));
+            memcpy(job.tail, rest, rest_len);
+        } else {
+            job.mid = NULL;
+            job.mid_nb = 0;
+            rest_len = st.m_len + len;
+            memset(job.tail, 0, sizeof(job.tail));
+            memcpy(job.tail, st.m_block, st.m_len);
+            memcpy(job.tail + st.m_len, msg, len);
+        }
+
+        size_t tail_nb = rest_len + 9 <= SHA224_256_BLOCK_SIZE ? 1 : 2;
+        job.tail[rest_len] = 0x80;
+        for (int j = 0; j < 8; j++) {
+            job.tail[(tail_nb << 6) - 1 - j] = (unsigned char) (bit_len >> (8 * j));
+        }
+        job.nb = (job.has_head ? 1 : 0) + job.mid_nb + tail_nb;
+    }
+
+    unsigned int use = lanes();
+    if (max_lanes < use) use = max_lanes >= 8 ? 8 : 1;
+    if (n < 2) use = 1;
+
+#ifdef SHA256_MULTI_BUFFER
+    if (use == 16) {
+        runLanes(jobs, digests, 16, compressAVX512, sha256_k);
+        return use;
+    } else if (use == 8) {
+        runLanes(jobs, digests, 8, compressAVX2, sha256_k);
+        return use;
+    }
+#endif
+
+    SHA256 ctx;
+    for (size_t i = 0; i < n; i++) {
+        memcpy(ctx.m_h, jobs[i].h, sizeof(ctx.m_h));
+        for (size_t b = 0; b < jobs[i].nb; b++) {
+            ctx.transform(jobs[i].block(b), 1);
+        }
+        storeDigest(ctx.m_h, 1, digests + i * DIGEST_SIZE);
+    }
+    return 1;
+}
+
 std::string sha256(std::string input)
 {
     unsigned char digest[SHA256::DIGEST_SIZE];
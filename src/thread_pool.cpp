@@ -0,0 +1,59 @@
+#include "thread_pool.h"
+
+namespace bls {
+  ThreadPool::ThreadPool(size_t num_threads) : stopping(false) {
+    if(num_threads == 0) num_threads = 1;
+
+    for(size_t i=0; i < num_threads; i++) {
+      workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+    }
+  }
+
+  ThreadPool::~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    cv.notify_all();
+
+    for(size_t i=0; i < workers.size(); i++) {
+      workers[i].join();
+    }
+  }
+
+  std::future<void> ThreadPool::submit(std::function<void()> task) {
+    std::packaged_task<void()> packaged(task);
+    std::future<void> result = packaged.get_future();
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      tasks.push(std::move(packaged));
+    }
+    cv.notify_one();
+
+    return result;
+  }
+
+  size_t ThreadPool::size() const {
+    return workers.size();
+  }
+
+  void ThreadPool::workerLoop() {
+    while(true) {
+      std::packaged_task<void()> task;
+
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this] { return stopping || !tasks.empty(); });
+
+        // drain the queue before stopping
+        if(tasks.empty()) return;
+
+        task = std::move(tasks.front());
+        tasks.pop();
+      }
+
+      task();
+    }
+  }
+}
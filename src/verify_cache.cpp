@@ -0,0 +1,138 @@
+#include <fstream>
+#include <algorithm>
+#include "verify_cache.h"
+
+namespace bls {
+  static const char SNAPSHOT_MAGIC[8] = {'B', 'L', 'S', 'V', 'C', 'v', '1', '\n'};
+
+  VerifyCache::VerifyCache(size_t capacity, size_t num_shards) :
+    num_hits(0), num_misses(0), num_evictions(0) {
+    if(num_shards == 0) num_shards = 1;
+    if(capacity < num_shards) num_shards = capacity == 0 ? 1 : capacity;
+
+    shard_capacity = (capacity + num_shards - 1) / num_shards;
+    if(shard_capacity == 0) shard_capacity = 1;
+
+    for(size_t i=0; i < num_shards; i++) {
+      shards.push_back(std::unique_ptr<shard>(new shard()));
+    }
+  }
+
+  VerifyCache::shard &VerifyCache::shardFor(const std::string &key) {
+    return *shards[std::hash<std::string>()(key) % shards.size()];
+  }
+
+  bool VerifyCache::contains(const std::string &key) {
+    shard &s = shardFor(key);
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    auto it = s.entries.find(key);
+    if(it == s.entries.end()) {
+      num_misses++;
+      return false;
+    }
+
+    s.lru.splice(s.lru.begin(), s.lru, it->second);
+    num_hits++;
+    return true;
+  }
+
+  void VerifyCache::insert(const std::string &key) {
+    shard &s = shardFor(key);
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    auto it = s.entries.find(key);
+    if(it != s.entries.end()) {
+      s.lru.splice(s.lru.begin(), s.lru, it->second);
+      return;
+    }
+
+    if(s.entries.size() >= shard_capacity) {
+      s.entries.erase(s.lru.back());
+      s.lru.pop_back();
+      num_evictions++;
+    }
+
+    s.lru.push_front(key);
+    s.entries[key] = s.lru.begin();
+  }
+
+  void VerifyCache::clear() {
+    for(size_t i=0; i < shards.size(); i++) {
+      std::lock_guard<std::mutex> lock(shards[i]->mutex);
+      shards[i]->entries.clear();
+      shards[i]->lru.clear();
+    }
+  }
+
+  size_t VerifyCache::size() {
+    size_t total = 0;
+    for(size_t i=0; i < shards.size(); i++) {
+      std::lock_guard<std::mutex> lock(shards[i]->mutex);
+      total += shards[i]->entries.size();
+    }
+    return total;
+  }
+
+  uint64_t VerifyCache::hits() const {
+    return num_hits;
+  }
+
+  uint64_t VerifyCache::misses() const {
+    return num_misses;
+  }
+
+  uint64_t VerifyCache::evictions() const {
+    return num_evictions;
+  }
+
+  bool VerifyCache::saveSnapshot(const char *path) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if(!out) return false;
+
+    out.write(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+
+    // entries: 4 byte little endian length followed by the key
+    for(size_t i=0; i < shards.size(); i++) {
+      std::lock_guard<std::mutex> lock(shards[i]->mutex);
+
+      // least recently used first, so reloading keeps the recency order
+      for(auto it = shards[i]->lru.rbegin(); it != shards[i]->lru.rend(); ++it) {
+        uint32_t len = it->size();
+        unsigned char len_bytes[4] = {
+          (unsigned char)len, (unsigned char)(len >> 8), (unsigned char)(len >> 16), (unsigned char)(len >> 24)
+        };
+        out.write((const char*)len_bytes, 4);
+        out.write(it->data(), it->size());
+      }
+    }
+
+    return (bool)out;
+  }
+
+  size_t VerifyCache::loadSnapshot(const char *path) {
+    std::ifstream in(path, std::ios::binary);
+    if(!in) return 0;
+
+    char magic[sizeof(SNAPSHOT_MAGIC)];
+    in.read(magic, sizeof(magic));
+    if(!in || !std::equal(magic, magic + sizeof(magic), SNAPSHOT_MAGIC)) return 0;
+
+    size_t loaded = 0;
+    unsigned char len_bytes[4];
+    while(in.read((char*)len_bytes, 4)) {
+      uint32_t len = len_bytes[0] | (len_bytes[1] << 8) | (len_bytes[2] << 16) | ((uint32_t)len_bytes[3] << 24);
+
+      // a corrupt length ends the load
+      if(len > (1 << 24)) break;
+
+      std::string key(len, '\0');
+      if(len > 0 && !in.read(&key[0], len)) break;
+
+      insert(key);
+      loaded++;
+    }
+
+    return loaded;
+  }
+}
@@ -0,0 +1,257 @@
+#include "verify_scheduler.h"
+
+namespace bls {
+  VerifyScheduler::VerifyScheduler(Bls &bls, const schedulerConfig &config)
+    : bls(bls), config(config), next_seq(0), stopping(false), high_started(0), low_started(0), high_wait_sum(0), low_wait_sum(0) {
+    if(this->config.num_workers == 0) this->config.num_workers = 1;
+    if(this->config.max_batch == 0) this->config.max_batch = 1;
+
+    // at least one worker has to serve the low priority lane
+    if(this->config.reserved_workers >= this->config.num_workers) {
+      this->config.reserved_workers = this->config.num_workers - 1;
+    }
+
+    counters = schedulerStats();
+
+    for(size_t i=0; i < this->config.num_workers; i++) {
+      workers.push_back(std::thread(&VerifyScheduler::workerLoop, this, i < this->config.reserved_workers));
+    }
+  }
+
+  VerifyScheduler::~VerifyScheduler() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    cv.notify_all();
+
+    for(size_t i=0; i < workers.size(); i++) {
+      workers[i].join();
+    }
+  }
+
+  schedulerConfig VerifyScheduler::defaultConfig() {
+    schedulerConfig config;
+    config.num_workers = 2;
+    config.reserved_workers = 1;
+    config.max_batch = 64;
+    config.batch_wait_us = 2000;
+    return config;
+  }
+
+  std::future<bool> VerifyScheduler::submit(const sigTriple &triple, VerifyPriority priority,
+    clock::time_point deadline) {
+    return submit(triple.pubkey, (const uint8_t*)triple.msg, strlen(triple.msg), triple.sig, priority, deadline);
+  }
+
+  std::future<bool> VerifyScheduler::submit(const PubKey &pubkey, const uint8_t *msg, size_t len, const Sig &sig,
+    VerifyPriority priority, clock::time_point deadline) {
+    std::shared_ptr<request> req = std::make_shared<request>();
+    req->priority = priority;
+    req->deadline = deadline;
+    req->messages.add(msg, len);
+    req->pubkeys.push_back(pubkey);
+    req->sig = sig.ec1;
+
+    return enqueue(req);
+  }
+
+  std::future<bool> VerifyScheduler::submitAgg(const std::vector<const char*> &messages,
+    const std::vector<PubKey> &pubkeys, const Sig &sig, VerifyPriority priority, clock::time_point deadline) {
+    if(messages.size() != pubkeys.size()) {
+      throw std::invalid_argument("Need one public key per message");
+    }
+
+    std::shared_ptr<request> req = std::make_shared<request>();
+    req->priority = priority;
+    req->deadline = deadline;
+    for(size_t i=0; i < messages.size(); i++) req->messages.add((const uint8_t*)messages[i], strlen(messages[i]));
+    req->pubkeys = pubkeys;
+    req->sig = sig.ec1;
+
+    return enqueue(req);
+  }
+
+  std::future<bool> VerifyScheduler::submitAgg(const msgArena &messages,
+    const std::vector<PubKey> &pubkeys, const Sig &sig, VerifyPriority priority, clock::time_point deadline) {
+    if(messages.count != pubkeys.size()) {
+      throw std::invalid_argument("Need one public key per message");
+    }
+
+    std::shared_ptr<request> req = std::make_shared<request>();
+    req->priority = priority;
+    req->deadline = deadline;
+    std::vector<msgRef> refs = Bls::toMsgRefs(messages);
+    for(size_t i=0; i < refs.size(); i++) req->messages.add(refs[i].data, refs[i].len);
+    req->pubkeys = pubkeys;
+    req->sig = sig.ec1;
+
+    return enqueue(req);
+  }
+
+  std::future<bool> VerifyScheduler::enqueue(std::shared_ptr<request> req) {
+    std::future<bool> result = req->result.get_future();
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      req->enqueued = clock::now();
+      req->seq = next_seq++;
+
+      if(req->priority == PRIORITY_HIGH) {
+        high_lane.push(req);
+      } else {
+        if(low_lane.empty()) low_since = req->enqueued;
+        low_lane.push(req);
+      }
+    }
+
+    // wake everyone: a batching worker may now have a full batch or a high priority request to run first
+    cv.notify_all();
+
+    return result;
+  }
+
+  schedulerStats VerifyScheduler::stats() {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    schedulerStats out = counters;
+    out.avg_high_wait_us = high_started ? high_wait_sum / high_started : 0;
+    out.avg_low_wait_us = low_started ? low_wait_sum / low_started : 0;
+    out.avg_low_batch_size = counters.low_batches ? (double)low_started / counters.low_batches : 0;
+
+    return out;
+  }
+
+  void VerifyScheduler::workerLoop(bool reserved) {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while(true) {
+      clock::time_point now = clock::now();
+
+      // high priority requests always go first, earliest deadline first
+      if(!high_lane.empty()) {
+        std::shared_ptr<request> req = high_lane.top();
+        high_lane.pop();
+
+        double wait_us = std::chrono::duration<double, std::micro>(now - req->enqueued).count();
+        high_started++;
+        high_wait_sum += wait_us;
+        if(wait_us > counters.max_high_wait_us) counters.max_high_wait_us = wait_us;
+
+        lock.unlock();
+        runOne(req);
+        lock.lock();
+        continue;
+      }
+
+      if(!reserved && !low_lane.empty()) {
+        // flush once the batch is full, has waited long enough, or its tightest deadline is due
+        clock::time_point flush_at = low_since + std::chrono::microseconds(config.batch_wait_us);
+        if(low_lane.top()->deadline < flush_at) flush_at = low_lane.top()->deadline;
+
+        if(stopping || low_lane.size() >= config.max_batch || now >= flush_at) {
+          std::vector<std::shared_ptr<request> > batch;
+          while(!low_lane.empty() && batch.size() < config.max_batch) {
+            std::shared_ptr<request> req = low_lane.top();
+            low_lane.pop();
+
+            double wait_us = std::chrono::duration<double, std::micro>(now - req->enqueued).count();
+            low_started++;
+            low_wait_sum += wait_us;
+            if(wait_us > counters.max_low_wait_us) counters.max_low_wait_us = wait_us;
+
+            batch.push_back(req);
+          }
+
+          // whatever is left starts the next batch
+          low_since = now;
+          counters.low_batches++;
+
+          lock.unlock();
+          runBatch(batch);
+          lock.lock();
+          continue;
+        }
+
+        cv.wait_until(lock, flush_at);
+        continue;
+      }
+
+      // the queues are drained before stopping
+      if(stopping) return;
+      cv.wait(lock);
+    }
+  }
+
+  void VerifyScheduler::runOne(std::shared_ptr<request> req) {
+    try {
+      bool valid;
+      if(req->messages.size() == 1) {
+        msgRef msg = req->messages[0];
+        valid = bls.verifySig(req->pubkeys[0], msg.data, msg.len, Sig(req->sig));
+      } else {
+        valid = bls.verifyAggSig(req->messages.arena(), req->pubkeys, Sig(req->sig));
+      }
+      finish(*req, valid, clock::now());
+    } catch(...) {
+      req->result.set_exception(std::current_exception());
+    }
+  }
+
+  void VerifyScheduler::runBatch(std::vector<std::shared_ptr<request> > &reqs) {
+    // single signatures share one batch check, aggregates run on their own
+    MessageBuffer batch;
+    std::vector<PubKey> pubkeys;
+    std::vector<Sig> sigs;
+    std::vector<size_t> batch_reqs;
+
+    for(size_t i=0; i < reqs.size(); i++) {
+      if(reqs[i]->messages.size() == 1) {
+        msgRef msg = reqs[i]->messages[0];
+        batch.add(msg.data, msg.len);
+        pubkeys.push_back(reqs[i]->pubkeys[0]);
+        sigs.push_back(Sig(reqs[i]->sig));
+        batch_reqs.push_back(i);
+      } else {
+        runOne(reqs[i]);
+      }
+    }
+
+    if(batch_reqs.empty()) return;
+
+    try {
+      std::vector<size_t> bad_indices;
+      bls.verifyBatch(batch.arena(), pubkeys, sigs, bad_indices);
+
+      std::vector<bool> valid(batch.size(), true);
+      for(size_t i=0; i < bad_indices.size(); i++) valid[bad_indices[i]] = false;
+
+      clock::time_point done = clock::now();
+      for(size_t i=0; i < batch.size(); i++) {
+        finish(*reqs[batch_reqs[i]], valid[i], done);
+      }
+    } catch(...) {
+      for(size_t i=0; i < batch_reqs.size(); i++) {
+        reqs[batch_reqs[i]]->result.set_exception(std::current_exception());
+      }
+    }
+  }
+
+  void VerifyScheduler::finish(request &req, bool valid, clock::time_point done) {
+    // record before fulfilling the promise so a caller reading stats() after get() sees this request
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      bool missed = done > req.deadline;
+
+      if(req.priority == PRIORITY_HIGH) {
+        counters.high_requests++;
+        if(missed) counters.high_deadline_misses++;
+      } else {
+        counters.low_requests++;
+        if(missed) counters.low_deadline_misses++;
+      }
+    }
+
+    req.result.set_value(valid);
+  }
+}